@@ -20,10 +20,14 @@
 #include <alarm.h>
 #include <dbScan.h>
 #include <dbAccess.h>
+#include <callback.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
 #include <epicsExport.h>
 
-#include <pevulib.h>
-#include <pevxulib.h>
+#include "toscaPev.h"
 
 #define I2CEXEC_OK      0x0200000
 #define I2CEXEC_MASK    0x0300000
@@ -52,8 +56,151 @@ typedef struct ifcPrivate{
     IfcDevType devType;
     unsigned int card;
     unsigned int count;
+    /* asynchronous BMR access */
+    CALLBACK callback;
+    struct ifcPrivate* next;
+    int write;
+    unsigned int value;
+    int status;
 } ifcPrivate;
 
+/* BMR access over I2C is slow, thus it is done asynchronously in a worker thread.
+   Queued reads of the same BMR are done in one session, identical reads only once.
+   Between sessions (and after writes) the same BMR is accessed again only after
+   ifcBmrPacing microseconds. Other BMRs can be accessed in the meantime.
+*/
+#define BMR_MAX 4
+int ifcBmrPacing = 1000;
+epicsExportAddress(int, ifcBmrPacing);
+
+static struct {
+    epicsMutexId lock;
+    epicsEventId wakeup;
+    ifcPrivate* first;
+    ifcPrivate* last;
+    epicsTimeStamp ready[BMR_MAX];
+} ifcBmr;
+
+static void ifcBmrSession(ifcPrivate** list, unsigned int card)
+{
+    ifcPrivate *p, **pp, *done = NULL;
+    epicsTimeStamp now;
+    size_t i, nreads = 0;
+    int wrote = 0; /* pace the next access to this BMR */
+    struct { unsigned int address, count, value; int status; } reads[16];
+
+    /* Unlink all requests for card from list, keeping the order */
+    for (pp = list; (p = *pp) != NULL;)
+    {
+        if (p->card != card) { pp = &p->next; continue; }
+        *pp = p->next;
+        if (p->write)
+        {
+            if (wrote) epicsThreadSleep(ifcBmrPacing * 1e-6);
+            p->status = pevBmrWrite(card, p->address, p->value, p->count) == 0 ? 0 : errno ? errno : EIO;
+            nreads = 0; /* values may have changed */
+            wrote = 1;
+        }
+        else
+        {
+            for (i = 0; i < nreads; i++)
+                if (reads[i].address == p->address && reads[i].count == p->count) break;
+            if (i == nreads)
+            {
+                if (wrote) epicsThreadSleep(ifcBmrPacing * 1e-6);
+                wrote = 0;
+                if (nreads == sizeof(reads)/sizeof(reads[0])) nreads = i = 0;
+                reads[i].address = p->address;
+                reads[i].count = p->count;
+                reads[i].status = pevBmrRead(card, p->address, &reads[i].value, p->count) == 0 ? 0 : errno ? errno : EIO;
+                nreads++;
+            }
+            else
+                debugLvl(2, "bmr=%u address=0x%x merged", card, p->address);
+            p->value = reads[i].value;
+            p->status = reads[i].status;
+        }
+        p->next = done;
+        done = p;
+    }
+    epicsTimeGetCurrent(&now);
+    epicsTimeAddSeconds(&now, ifcBmrPacing * 1e-6);
+    ifcBmr.ready[card] = now;
+
+    /* Complete the records */
+    while (done)
+    {
+        p = done;
+        done = p->next;
+        callbackRequestProcessCallback(&p->callback, priorityLow, p->callback.user);
+    }
+}
+
+static void ifcBmrWorker(void* arg __attribute__((unused)))
+{
+    ifcPrivate* list;
+    epicsTimeStamp now;
+    unsigned int card;
+    double wait;
+
+    while (1)
+    {
+        epicsEventMustWait(ifcBmr.wakeup);
+        while (1)
+        {
+            epicsMutexMustLock(ifcBmr.lock);
+            list = ifcBmr.first;
+            ifcBmr.first = ifcBmr.last = NULL;
+            epicsMutexUnlock(ifcBmr.lock);
+            if (!list) break;
+            while (list)
+            {
+                /* Serve the BMR that is ready first */
+                card = list->card;
+                {
+                    ifcPrivate* p;
+                    for (p = list->next; p; p = p->next)
+                        if (epicsTimeLessThan(&ifcBmr.ready[p->card], &ifcBmr.ready[card]))
+                            card = p->card;
+                }
+                epicsTimeGetCurrent(&now);
+                wait = epicsTimeDiffInSeconds(&ifcBmr.ready[card], &now);
+                if (wait > 0) epicsThreadSleep(wait);
+                ifcBmrSession(&list, card);
+            }
+        }
+    }
+}
+
+static void ifcBmrInit(void* arg __attribute__((unused)))
+{
+    ifcBmr.lock = epicsMutexMustCreate();
+    ifcBmr.wakeup = epicsEventMustCreate(epicsEventEmpty);
+    epicsThreadMustCreate("ifcBmr", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackSmall), ifcBmrWorker, NULL);
+}
+
+static void ifcBmrRequest(dbCommon* record, int write, unsigned int value)
+{
+    static epicsThreadOnceId once = EPICS_THREAD_ONCE_INIT;
+    ifcPrivate* p = record->dpvt;
+
+    epicsThreadOnce(&once, ifcBmrInit, NULL);
+    p->write = write;
+    p->value = value;
+    p->next = NULL;
+    p->callback.user = record;
+    record->pact = 1;
+    epicsMutexMustLock(ifcBmr.lock);
+    if (ifcBmr.last)
+        ifcBmr.last->next = p;
+    else
+        ifcBmr.first = p;
+    ifcBmr.last = p;
+    epicsMutexUnlock(ifcBmr.lock);
+    epicsEventSignal(ifcBmr.wakeup);
+}
+
 long devIfc1210InitRecord(dbCommon* record, struct link* link)
 {
     ifcPrivate* p;
@@ -64,7 +211,7 @@ long devIfc1210InitRecord(dbCommon* record, struct link* link)
             "ifc: Wrong type of io link");
         return S_db_badField;
     }
-    if ((p = malloc(sizeof(ifcPrivate))) == NULL)
+    if ((p = calloc(1, sizeof(ifcPrivate))) == NULL)
     {
         recGblRecordError(errno, record,
             "devIfc1210InitRecord: Out of memory");
@@ -120,6 +267,14 @@ long devIfc1210InitRecord(dbCommon* record, struct link* link)
         return S_db_badField;
     }
 
+    if (p->devType >= BMR && p->card >= BMR_MAX)
+    {
+        recGblRecordError(S_db_badField, record,
+            "devIfc1210InitRecord: Illegal BMR number");
+        free(p);
+        return S_db_badField;
+    }
+
     record->dpvt = p;
     return 0;
 }
@@ -140,7 +295,6 @@ long devIfc1210AiRead(aiRecord* record)
 {
     ifcPrivate* p = record->dpvt;
     unsigned int rval = 0;
-    int status = 0;
 
     if (p == NULL)
     {
@@ -163,14 +317,20 @@ long devIfc1210AiRead(aiRecord* record)
             rval = pev_csr_rd( p->address | 0x80000000 );
             break;
         default:
-            status = pev_bmr_read( p->card,  p->address, &rval, p->count);
-            if ((status&I2CEXEC_MASK) != I2CEXEC_OK)
+            if (!record->pact)
             {
-                error("%s: pev_bmr_read bmr=%d addr=%d failed: %m",
+                ifcBmrRequest((dbCommon*)record, 0, 0);
+                return 0;
+            }
+            if (p->status != 0)
+            {
+                errno = p->status;
+                error("%s: pevBmrRead bmr=%d addr=%d failed: %m",
                     record->name, p->card, p->address);
                 recGblSetSevr(record, READ_ALARM, INVALID_ALARM);
                 return -1;
             }
+            rval = p->value;
     }
 
     switch (p->devType)
@@ -247,7 +407,21 @@ long devIfc1210AoWrite(aoRecord* record)
         pev_csr_wr( p->address | 0x80000000, record->rval);
     else
     if (p->devType == BMR)
-        pev_bmr_write(p->card, p->address, record->rval, p->count);
+    {
+        if (!record->pact)
+        {
+            ifcBmrRequest((dbCommon*)record, 1, record->rval);
+            return 0;
+        }
+        if (p->status != 0)
+        {
+            errno = p->status;
+            error("%s: pevBmrWrite bmr=%d addr=%d failed: %m",
+                record->name, p->card, p->address);
+            recGblSetSevr(record, WRITE_ALARM, INVALID_ALARM);
+            return -1;
+        }
+    }
 
     return 0;
 }
@@ -287,7 +461,6 @@ long devIfc1210LonginRead(longinRecord* record)
 {
     ifcPrivate* p = record->dpvt;
     unsigned int rval = 0;
-    int status = 0;
 
     if (p == NULL)
     {
@@ -310,14 +483,20 @@ long devIfc1210LonginRead(longinRecord* record)
             rval = pev_csr_rd( p->address | 0x80000000 );
             break;
         default:
-            status = pev_bmr_read( p->card,  p->address, &rval, p->count);
-            if ((status&I2CEXEC_MASK) != I2CEXEC_OK)
+            if (!record->pact)
+            {
+                ifcBmrRequest((dbCommon*)record, 0, 0);
+                return 0;
+            }
+            if (p->status != 0)
             {
-                error("%s: pev_bmr_read bmr=%d addr=%d failed: %m",
+                errno = p->status;
+                error("%s: pevBmrRead bmr=%d addr=%d failed: %m",
                     record->name, p->card, p->address);
                 recGblSetSevr(record, READ_ALARM, INVALID_ALARM);
                 return -1;
             }
+            rval = p->value;
     }
     switch (p->devType)
     {
@@ -389,7 +568,21 @@ long devIfc1210LongoutWrite(longoutRecord* record)
         pev_csr_wr( p->address | 0x80000000, record->val);
     else
     if (p->devType == BMR)
-        pev_bmr_write(p->card, p->address, record->val, p->count);
+    {
+        if (!record->pact)
+        {
+            ifcBmrRequest((dbCommon*)record, 1, record->val);
+            return 0;
+        }
+        if (p->status != 0)
+        {
+            errno = p->status;
+            error("%s: pevBmrWrite bmr=%d addr=%d failed: %m",
+                record->name, p->card, p->address);
+            recGblSetSevr(record, WRITE_ALARM, INVALID_ALARM);
+            return -1;
+        }
+    }
 
     return 0;
 }
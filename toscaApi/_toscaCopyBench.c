@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <byteswap.h>
+#include "toscaApi.h"
+
+/* Measure the throughput of toscaCopySwap compared to a loop
+   over single elements (what regDevCopy does) for all swap widths
+   and of toscaCopyRead for all read widths. */
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void elementLoop(volatile void* dest, const volatile void* src, size_t nelem, unsigned int swap)
+{
+    size_t i;
+    switch (swap)
+    {
+        case 1:
+            for (i = 0; i < nelem; i++)
+                ((volatile uint8_t*)dest)[i] = ((volatile uint8_t*)src)[i];
+            break;
+        case 2:
+            for (i = 0; i < nelem; i++)
+                ((volatile uint16_t*)dest)[i] = bswap_16(((volatile uint16_t*)src)[i]);
+            break;
+        case 4:
+            for (i = 0; i < nelem; i++)
+                ((volatile uint32_t*)dest)[i] = bswap_32(((volatile uint32_t*)src)[i]);
+            break;
+        case 8:
+            for (i = 0; i < nelem; i++)
+                ((volatile uint64_t*)dest)[i] = bswap_64(((volatile uint64_t*)src)[i]);
+            break;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t size = 0x10000;
+    unsigned int loops = 100, i, swap, width;
+    int lines;
+    volatile void* src;
+    void* dest;
+    double t, t0, t1;
+
+    if (argc > 1 && (argv[1][0] == '-' || argc > 4))
+    {
+        fprintf(stderr, "usage: toscaCopyBench [addrspace:address|RAM] [size] [loops]\n");
+        return 1;
+    }
+    if (argc > 2)
+        size = toscaStrToSize(argv[2]);
+    if (argc > 3)
+        loops = atoi(argv[3]);
+    if (argc > 1 && strcmp(argv[1], "RAM") != 0)
+    {
+        toscaMapAddr_t addr = toscaStrToAddr(argv[1], NULL);
+        src = toscaMap(addr.addrspace, addr.address, size, 0);
+        if (!src)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+    else
+    {
+        src = valloc(size);
+        if (!src)
+        {
+            perror(NULL);
+            return 1;
+        }
+        memset((void*)src, 0x5a, size);
+    }
+    dest = valloc(size);
+    if (!dest)
+    {
+        perror(NULL);
+        return 1;
+    }
+
+    printf("source %s, size 0x%zx, %u loops, vector implementation %s\n",
+        argc > 1 ? argv[1] : "RAM", size, loops, toscaCopyImpl());
+    printf("swap  elements MB/s  toscaCopySwap MB/s  speedup\n");
+    for (swap = 1; swap <= 8; swap <<= 1)
+    {
+        t = now();
+        for (i = 0; i < loops; i++)
+            elementLoop(dest, src, size / swap, swap);
+        t0 = now() - t;
+        t = now();
+        for (i = 0; i < loops; i++)
+            toscaCopySwap(dest, src, size / swap, swap);
+        t1 = now() - t;
+        printf("%4u  %13.1f  %18.1f  %7.2f\n", swap,
+            size * loops / t0 * 1e-6, size * loops / t1 * 1e-6, t0 / t1);
+    }
+    printf("width  toscaCopyRead MB/s with 1, 2, 4 lines in flight\n");
+    for (width = 1; width <= 32; width <<= 1)
+    {
+        printf("%5u", width);
+        for (lines = 1; lines <= 4; lines <<= 1)
+        {
+            toscaCopyReadLines = lines;
+            t = now();
+            for (i = 0; i < loops; i++)
+                toscaCopyRead(dest, src, size, width);
+            t1 = now() - t;
+            printf("  %10.1f", size * loops / t1 * 1e-6);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include "toscaApi.h"
+
+/* Measure the cost of the first access to each page of a map
+   compared to a second access, with the number of page faults
+   and (if the kernel supports perf events) data TLB misses.
+   Run with different toscaMapPopulate, toscaMapAlign settings
+   or after toscaMapPrefault to compare. */
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static long faults(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+static int tlbCounter(void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long tlbRead(int fd)
+{
+    long long count = -1;
+    if (fd >= 0 && read(fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+    return count;
+}
+
+static void touch(const volatile void* ptr, size_t size, size_t step, int fd,
+    double* t, long* nfaults, long long* tlbmisses)
+{
+    size_t offs;
+    long f;
+    long long tlb;
+    double t0;
+
+    f = faults();
+    tlb = tlbRead(fd);
+    t0 = now();
+    for (offs = 0; offs < size; offs += step)
+        (void)*(volatile uint32_t*)((volatile char*)ptr + offs);
+    *t = now() - t0;
+    *nfaults = faults() - f;
+    *tlbmisses = tlb >= 0 ? tlbRead(fd) - tlb : -1;
+}
+
+int main(int argc, char** argv)
+{
+    size_t size = 0x100000, pagesize = sysconf(_SC_PAGESIZE), npages;
+    toscaMapAddr_t addr;
+    volatile void* ptr;
+    double t0, t1;
+    long f0, f1;
+    long long tlb0, tlb1;
+    int i, fd, prefault = 0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-p") == 0) toscaMapPopulate = 1;
+        else if (strcmp(argv[i], "-a") == 0 && i+1 < argc) toscaMapAlign = toscaStrToSize(argv[++i]);
+        else if (strcmp(argv[i], "-f") == 0) prefault = 1;
+        else break;
+    }
+    if (i >= argc || argc - i > 2)
+    {
+        fprintf(stderr, "usage: toscaMapBench [-p] [-a align] [-f] addrspace:address [size]\n"
+            "  -p: map with MAP_POPULATE\n"
+            "  -a: align map to align bytes (e.g. 2M)\n"
+            "  -f: call toscaMapPrefault before measuring\n");
+        return 1;
+    }
+    addr = toscaStrToAddr(argv[i], NULL);
+    if (argc - i > 1)
+        size = toscaStrToSize(argv[i+1]);
+    npages = (size + pagesize - 1) / pagesize;
+
+    t0 = now();
+    ptr = toscaMap(addr.addrspace, addr.address, size, 0);
+    t0 = now() - t0;
+    if (!ptr)
+    {
+        perror(argv[i]);
+        return 1;
+    }
+    printf("%s size 0x%zx (%zu pages) mapped at %p in %.3f ms\n",
+        argv[i], size, npages, ptr, t0 * 1e3);
+    if (prefault)
+    {
+        t0 = now();
+        toscaMapPrefault(ptr, size);
+        printf("prefault %.3f ms\n", (now() - t0) * 1e3);
+    }
+    fd = tlbCounter();
+    if (fd < 0) printf("no perf events: TLB misses not available\n");
+    else ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+    touch(ptr, size, pagesize, fd, &t0, &f0, &tlb0);
+    touch(ptr, size, pagesize, fd, &t1, &f1, &tlb1);
+    printf("access  us/page  page faults  dTLB misses\n");
+    printf("first   %7.3f  %11ld  %11lld\n", t0 / npages * 1e6, f0, tlb0);
+    printf("second  %7.3f  %11ld  %11lld\n", t1 / npages * 1e6, f1, tlb1);
+    return 0;
+}
@@ -2,3 +2,5 @@
 #include "toscaReg.h"
 #include "toscaIntr.h"
 #include "toscaDma.h"
+#include "toscaCopy.h"
+#include "toscaSlave.h"
@@ -0,0 +1,438 @@
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <byteswap.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VECTOR_IMPL "AVX2"
+#define VECTOR_WIDTH 32
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define VECTOR_IMPL "SSSE3"
+#define VECTOR_WIDTH 16
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VECTOR_IMPL "SSE2"
+#define VECTOR_WIDTH 16
+#elif defined(__ALTIVEC__)
+#include <altivec.h>
+#undef vector
+#undef pixel
+#undef bool
+#define VECTOR_IMPL "AltiVec"
+#define VECTOR_WIDTH 16
+#else
+#define VECTOR_IMPL "none"
+#define VECTOR_WIDTH 0
+#endif
+
+#include "toscaMap.h"
+#include "toscaCopy.h"
+
+#define TOSCA_DEBUG_NAME toscaCopy
+#include "toscaDebug.h"
+
+int toscaCopyMaxWidth;
+int toscaCopyReadLines = 4;
+
+const char* toscaCopyImpl(void)
+{
+    return VECTOR_IMPL;
+}
+
+/* Single elements, also used for head and tail of the wide copy. */
+static void toscaCopyElements(volatile char* d, const volatile char* s, size_t nelem, unsigned int swap)
+{
+    size_t i;
+    switch (swap)
+    {
+        case 1:
+            for (i = 0; i < nelem; i++)
+                d[i] = s[i];
+            break;
+        case 2:
+            for (i = 0; i < nelem; i++)
+                ((volatile uint16_t*)d)[i] = bswap_16(((volatile uint16_t*)s)[i]);
+            break;
+        case 4:
+            for (i = 0; i < nelem; i++)
+                ((volatile uint32_t*)d)[i] = bswap_32(((volatile uint32_t*)s)[i]);
+            break;
+        case 8:
+            for (i = 0; i < nelem; i++)
+                ((volatile uint64_t*)d)[i] = bswap_64(((volatile uint64_t*)s)[i]);
+            break;
+    }
+}
+
+/* Native words with the swap done in registers ("SIMD within a register").
+   The switch is outside the loops to keep the loops tight. */
+#define M8 ((unsigned long)-1/0xffff*0xff) /* 0x00ff00ff... */
+#define COPY_WORDS(expr) \
+    for (i = 0; i < nwords; i++) { x = ((volatile unsigned long*)s)[i]; ((volatile unsigned long*)d)[i] = (expr); }
+
+static void toscaCopyWords(volatile char* d, const volatile char* s, size_t nwords, unsigned int swap)
+{
+    size_t i;
+    unsigned long x;
+    switch (swap)
+    {
+        case 1:
+            COPY_WORDS(x);
+            break;
+        case 2:
+            COPY_WORDS(((x >> 8) & M8) | ((x & M8) << 8));
+            break;
+#if ULONG_MAX > 0xffffffffUL
+        case 4:
+            COPY_WORDS((x = bswap_64(x), (x >> 32) | (x << 32)));
+            break;
+        case 8:
+            COPY_WORDS(bswap_64(x));
+            break;
+#else
+        case 4:
+            COPY_WORDS(bswap_32(x));
+            break;
+#endif
+    }
+}
+
+#if VECTOR_WIDTH
+/* Byte shuffle patterns within 16 byte lanes for swap 1, 2, 4, 8 */
+static const uint8_t shuffle[4][VECTOR_WIDTH] __attribute__((aligned(VECTOR_WIDTH))) = {
+#define LANE1 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15
+#define LANE2 1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14
+#define LANE4 3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12
+#define LANE8 7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8
+#if VECTOR_WIDTH == 32
+    { LANE1, LANE1 }, { LANE2, LANE2 }, { LANE4, LANE4 }, { LANE8, LANE8 }
+#else
+    { LANE1 }, { LANE2 }, { LANE4 }, { LANE8 }
+#endif
+};
+
+/* Both pointers must be aligned to VECTOR_WIDTH. */
+static void toscaCopyVectors(volatile char* d, const volatile char* s, size_t nvec, unsigned int swap)
+{
+    size_t i;
+    const uint8_t* pattern = shuffle[swap == 1 ? 0 : swap == 2 ? 1 : swap == 4 ? 2 : 3];
+#if defined(__AVX2__)
+    __m256i mask = _mm256_load_si256((const __m256i*)pattern);
+    for (i = 0; i < nvec; i++)
+        _mm256_store_si256((__m256i*)d + i,
+            _mm256_shuffle_epi8(_mm256_load_si256((const __m256i*)s + i), mask));
+#elif defined(__SSSE3__)
+    __m128i mask = _mm_load_si128((const __m128i*)pattern);
+    for (i = 0; i < nvec; i++)
+        _mm_store_si128((__m128i*)d + i,
+            _mm_shuffle_epi8(_mm_load_si128((const __m128i*)s + i), mask));
+#elif defined(__SSE2__)
+    /* no byte shuffle: swap bytes in words, then words in dwords or qwords */
+    __m128i x;
+    (void)pattern;
+    for (i = 0; i < nvec; i++)
+    {
+        x = _mm_load_si128((const __m128i*)s + i);
+        if (swap > 1)
+            x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        if (swap == 4)
+            x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xb1), 0xb1);
+        if (swap == 8)
+            x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0x1b), 0x1b);
+        _mm_store_si128((__m128i*)d + i, x);
+    }
+#elif defined(__ALTIVEC__)
+    __vector unsigned char mask = vec_ld(0, pattern), x;
+    for (i = 0; i < nvec; i++)
+    {
+        x = vec_ld(i * 16, (const unsigned char*)s);
+        vec_st(vec_perm(x, x, mask), i * 16, (unsigned char*)d);
+    }
+#endif
+    /* vector intrinsics are not volatile: do not let the compiler move other accesses across */
+    __asm__ volatile ("" ::: "memory");
+}
+#endif
+
+int toscaCopySwap(volatile void* dest, const volatile void* src, size_t nelem, unsigned int swap)
+{
+    return toscaCopySwapWidth(dest, src, nelem, swap, 0);
+}
+
+int toscaCopySwapWidth(volatile void* dest, const volatile void* src, size_t nelem, unsigned int swap, unsigned int maxwidth)
+{
+    volatile char* d = dest;
+    const volatile char* s = src;
+    size_t width, n;
+
+    if (swap == 0) swap = 1;
+    if (swap != 1 && swap != 2 && swap != 4 && swap != 8)
+    {
+        debug("invalid swap %u", swap);
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Find the widest access that fits to the alignment of both sides. */
+    width = VECTOR_WIDTH ? VECTOR_WIDTH : sizeof(unsigned long);
+    if (maxwidth > 0)
+        while (width > maxwidth) width >>= 1;
+    if (toscaCopyMaxWidth > 0)
+        while (width > (size_t)toscaCopyMaxWidth) width >>= 1;
+    while (width > swap && ((size_t)d - (size_t)s) % width) width >>= 1;
+    if (width > sizeof(unsigned long) && width < VECTOR_WIDTH)
+        width = sizeof(unsigned long);
+    if (width < sizeof(unsigned long) || width < swap || (size_t)s % swap)
+    {
+        /* nothing wider than single elements possible */
+        toscaCopyElements(d, s, nelem, swap);
+        return 0;
+    }
+    debugLvl(2, "dest=%p src=%p nelem=%zu swap=%u width=%zu", d, s, nelem, swap, width);
+
+    /* head: single elements up to the first aligned address */
+    n = ((width - (size_t)s % width) % width) / swap;
+    if (n > nelem) n = nelem;
+    toscaCopyElements(d, s, n, swap);
+    d += n * swap;
+    s += n * swap;
+    nelem -= n;
+
+    /* bulk: wide accesses */
+    n = nelem * swap / width;
+#if VECTOR_WIDTH
+    if (width == VECTOR_WIDTH)
+        toscaCopyVectors(d, s, n, swap);
+    else
+#endif
+        toscaCopyWords(d, s, n, swap);
+    d += n * width;
+    s += n * width;
+    nelem -= n * width / swap;
+
+    /* tail: remaining single elements */
+    toscaCopyElements(d, s, nelem, swap);
+    return 0;
+}
+
+unsigned int toscaCopySwapMaxWidth(unsigned int addrspace)
+{
+    if (!addrspace)
+        return 0; /* plain memory */
+    if ((addrspace & TOSCA_SMEM2) == TOSCA_SMEM2 || addrspace & (TOSCA_SMEM1|TOSCA_SRAM|VME_SLAVE))
+        return VECTOR_WIDTH ? VECTOR_WIDTH : sizeof(unsigned long); /* memory */
+    return 1; /* registers: single elements only */
+}
+
+unsigned int toscaCopyReadWidth(unsigned int addrspace)
+{
+    if ((addrspace & TOSCA_SMEM2) == TOSCA_SMEM2 || addrspace & (TOSCA_SMEM1|TOSCA_SRAM))
+        return VECTOR_WIDTH ? 16 : 8; /* memory */
+    if (addrspace & (TOSCA_CSR|TOSCA_IO|VME_A16|VME_A24|VME_CRCSR))
+        return 4; /* registers */
+    return 8; /* USER blocks, A32, slave windows */
+}
+
+/* Single loads for head and tail */
+static void toscaCopyReadSingle(char* d, const volatile char* s, unsigned int w)
+{
+    switch (w)
+    {
+        case 1:
+            *d = *s;
+            break;
+        case 2:
+        {
+            uint16_t x = *(volatile uint16_t*)s;
+            memcpy(d, &x, 2);
+            break;
+        }
+        case 4:
+        {
+            uint32_t x = *(volatile uint32_t*)s;
+            memcpy(d, &x, 4);
+            break;
+        }
+        case 8:
+        {
+            uint64_t x = *(volatile uint64_t*)s;
+            memcpy(d, &x, 8);
+            break;
+        }
+    }
+}
+
+/* Each read is a PCIe round trip. Issue loads from several 64 byte lines
+   before storing anything so that the CPU can keep them in flight. */
+#define LINE 64
+#define READ_BULK(T, LOAD, STORE) \
+{ \
+    size_t j; \
+    T a, b, c, e; \
+    if (toscaCopyReadLines >= 4) \
+        for (; n >= 4 * LINE / sizeof(T); n -= 4 * LINE / sizeof(T), s += 4 * LINE, d += 4 * LINE) \
+            for (j = 0; j < LINE; j += sizeof(T)) \
+            { \
+                a = LOAD(s + j); b = LOAD(s + LINE + j); c = LOAD(s + 2 * LINE + j); e = LOAD(s + 3 * LINE + j); \
+                STORE(d + j, a); STORE(d + LINE + j, b); STORE(d + 2 * LINE + j, c); STORE(d + 3 * LINE + j, e); \
+            } \
+    if (toscaCopyReadLines >= 2) \
+        for (; n >= 2 * LINE / sizeof(T); n -= 2 * LINE / sizeof(T), s += 2 * LINE, d += 2 * LINE) \
+            for (j = 0; j < LINE; j += sizeof(T)) \
+            { \
+                a = LOAD(s + j); b = LOAD(s + LINE + j); \
+                STORE(d + j, a); STORE(d + LINE + j, b); \
+            } \
+    for (; n; n--, s += sizeof(T), d += sizeof(T)) \
+    { \
+        a = LOAD(s); \
+        STORE(d, a); \
+    } \
+}
+#define LOAD_U8(p) (*(volatile uint8_t*)(p))
+#define LOAD_U16(p) (*(volatile uint16_t*)(p))
+#define LOAD_U32(p) (*(volatile uint32_t*)(p))
+#define LOAD_U64(p) (*(volatile uint64_t*)(p))
+#define STORE_MEM(p, x) memcpy(p, &x, sizeof(x))
+#if defined(__AVX2__)
+#define LOAD_V32(p) _mm256_load_si256((const __m256i*)(p))
+#define STORE_V32(p, x) _mm256_storeu_si256((__m256i*)(p), x)
+#endif
+#if defined(__SSE2__)
+#define LOAD_V16(p) _mm_load_si128((const __m128i*)(p))
+#define STORE_V16(p, x) _mm_storeu_si128((__m128i*)(p), x)
+typedef __m128i v16_t;
+#elif defined(__ALTIVEC__)
+#define LOAD_V16(p) vec_ld(0, (const unsigned char*)(p))
+#define STORE_V16(p, x) memcpy(p, &x, 16)
+typedef __vector unsigned char v16_t;
+#endif
+
+int toscaCopyRead(void* dest, const volatile void* src, size_t size, unsigned int width)
+{
+    char* d = dest;
+    const volatile char* s = src;
+    unsigned int w;
+    size_t n;
+
+    if (width == 0 || width & (width - 1))
+    {
+        debug("invalid width %u", width);
+        errno = EINVAL;
+        return -1;
+    }
+    while (width > (VECTOR_WIDTH ? VECTOR_WIDTH : 8)) width >>= 1;
+    if (toscaCopyMaxWidth > 0)
+        while (width > 1 && width > (unsigned int)toscaCopyMaxWidth) width >>= 1;
+    debugLvl(2, "dest=%p src=%p size=0x%zx width=%u lines=%d", d, s, size, width, toscaCopyReadLines);
+
+    /* head: narrower loads up to the first aligned address */
+    while (size && (size_t)s % width)
+    {
+        w = (size_t)s & -(size_t)s;
+        if (w > 8) w = 8;
+        while (w > size) w >>= 1;
+        toscaCopyReadSingle(d, s, w);
+        d += w;
+        s += w;
+        size -= w;
+    }
+
+    /* bulk: wide loads, several in flight */
+    n = size / width;
+    size -= n * width;
+    switch (width)
+    {
+        case 1: READ_BULK(uint8_t, LOAD_U8, STORE_MEM); break;
+        case 2: READ_BULK(uint16_t, LOAD_U16, STORE_MEM); break;
+        case 4: READ_BULK(uint32_t, LOAD_U32, STORE_MEM); break;
+        case 8: READ_BULK(uint64_t, LOAD_U64, STORE_MEM); break;
+#if VECTOR_WIDTH
+        case 16: READ_BULK(v16_t, LOAD_V16, STORE_V16); break;
+#endif
+#if VECTOR_WIDTH == 32
+        case 32: READ_BULK(__m256i, LOAD_V32, STORE_V32); break;
+#endif
+    }
+    /* vector loads are not volatile: do not let the compiler move other accesses across */
+    __asm__ volatile ("" ::: "memory");
+
+    /* tail: narrower loads */
+    while (size)
+    {
+        w = 8;
+        while (w > size) w >>= 1;
+        toscaCopyReadSingle(d, s, w);
+        d += w;
+        s += w;
+        size -= w;
+    }
+    return 0;
+}
+
+/* Integer to double conversion.
+   SSE2 has packed int32 to double conversion, so use it for the signed
+   types, the compiler can vectorize the plain loops for the others. */
+#define CONVERT_LOOP(T) \
+    for (; i < nelem; i++) dest[i] = ((const T*)src)[i] * scale + offset;
+
+int toscaCopyToDouble(double* dest, const void* src, size_t nelem, unsigned int rawlen, int issigned, double scale, double offset)
+{
+    size_t i = 0;
+
+    switch (rawlen * (issigned ? -1 : 1))
+    {
+        case 1:
+            CONVERT_LOOP(uint8_t);
+            break;
+        case -1:
+            CONVERT_LOOP(int8_t);
+            break;
+        case 2:
+            CONVERT_LOOP(uint16_t);
+            break;
+        case -2:
+#if defined(__SSE2__)
+        {
+            __m128d s = _mm_set1_pd(scale), o = _mm_set1_pd(offset);
+            for (; i + 8 <= nelem; i += 8)
+            {
+                __m128i x = _mm_loadu_si128((const __m128i*)((const int16_t*)src + i));
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16); /* sign extend */
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+                _mm_storeu_pd(dest + i,     _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(lo), s), o));
+                _mm_storeu_pd(dest + i + 2, _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), s), o));
+                _mm_storeu_pd(dest + i + 4, _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(hi), s), o));
+                _mm_storeu_pd(dest + i + 6, _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), s), o));
+            }
+        }
+#endif
+            CONVERT_LOOP(int16_t);
+            break;
+        case 4:
+            CONVERT_LOOP(uint32_t);
+            break;
+        case -4:
+#if defined(__SSE2__)
+        {
+            __m128d s = _mm_set1_pd(scale), o = _mm_set1_pd(offset);
+            for (; i + 4 <= nelem; i += 4)
+            {
+                __m128i x = _mm_loadu_si128((const __m128i*)((const int32_t*)src + i));
+                _mm_storeu_pd(dest + i,     _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(x), s), o));
+                _mm_storeu_pd(dest + i + 2, _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(x, 8)), s), o));
+            }
+        }
+#endif
+            CONVERT_LOOP(int32_t);
+            break;
+        default:
+            debug("invalid rawlen %u", rawlen);
+            errno = EINVAL;
+            return -1;
+    }
+    return 0;
+}
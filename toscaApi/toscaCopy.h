@@ -0,0 +1,70 @@
+#ifndef toscaCopy_h
+#define toscaCopy_h
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* set to 1 to see debug output */
+extern int toscaCopyDebug;
+
+/* set to redirect debug output  */
+extern FILE* toscaCopyDebugFile;
+
+/* Copy nelem elements of swap bytes each (1, 2, 4, 8) from src to dest
+   and swap the byte order of each element (swap = 1: plain copy).
+   Either side may be a memory map.
+   The bulk of the data is moved with the widest access available
+   (SSE/AVX2 on x86, AltiVec on PowerPC if compiled for it, else
+   the native word size), head and tail with single elements.
+   Returns 0 on success or -1 with errno set for invalid swap.
+*/
+int toscaCopySwap(volatile void* dest, const volatile void* src, size_t nelem, unsigned int swap);
+
+/* Same as toscaCopySwap but with accesses of at most maxwidth bytes
+   (0 = no limit, 1 = single elements only). */
+int toscaCopySwapWidth(volatile void* dest, const volatile void* src, size_t nelem, unsigned int swap, unsigned int maxwidth);
+
+/* Maximum toscaCopySwapWidth access width for a map of an address space:
+   vector width only for SMEM, SRAM and slave windows (memory),
+   1 for register spaces (USER, CSR, IO, VME), 0 for addrspace 0 (RAM). */
+unsigned int toscaCopySwapMaxWidth(unsigned int addrspace);
+
+/* Limit the access width in bytes for all address spaces (0 = no limit).
+   Set for example to 4 if a memory does not support wider accesses. */
+extern int toscaCopyMaxWidth;
+
+/* Read size bytes from a memory map into (non-mapped) memory at dest.
+   Reads are non-posted and thus slow, so use loads of width bytes
+   (1, 2, 4, 8, or 16 and 32 with vector support) and keep loads from
+   toscaCopyReadLines different 64 byte lines in flight.
+   Head and tail are read with narrower loads as alignment requires.
+   Widths not supported by the CPU are reduced to the widest supported.
+   Returns 0 on success or -1 with errno set for invalid width.
+*/
+int toscaCopyRead(void* dest, const volatile void* src, size_t size, unsigned int width);
+
+/* Number of lines with loads in flight (default 4, 1 = strictly sequential) */
+extern int toscaCopyReadLines;
+
+/* Default read width for an address space (see toscaMap.h),
+   e.g. 4 for CSR registers or 16 for SMEM with vector support. */
+unsigned int toscaCopyReadWidth(unsigned int addrspace);
+
+/* Convert nelem integers of rawlen bytes (1, 2, 4) in host byte order,
+   signed or unsigned, to dest[i] = src[i] * scale + offset in one pass.
+   Returns 0 on success or -1 with errno set for invalid rawlen.
+*/
+int toscaCopyToDouble(double* dest, const void* src, size_t nelem, unsigned int rawlen, int issigned, double scale, double offset);
+
+/* Name of the vector implementation compiled in. */
+const char* toscaCopyImpl(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -252,6 +252,7 @@ struct dmaRequest
     int flags;
     toscaDmaCallback callback;
     void *user;
+    uint32_t intrDevices; /* devices with toscaIntrConnectDma handlers */
     struct dmaRequest* next;
 } *pending, *freelist, **insert=&pending;
 
@@ -303,6 +304,49 @@ int toscaDmaDoTransfer(struct dmaRequest* r)
     return 0;
 }
 
+static void toscaDmaIntrHandler(struct dmaRequest* r, unsigned int inum, unsigned int ivec)
+{
+    int status;
+    struct timespec start, finished;
+
+    if (r->fd <= 0) return; /* released but not disconnected */
+    if (toscaDmaDebug)
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    status = toscaDmaDoTransfer(r);
+    if (toscaDmaDebug)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &finished);
+        debug("inum=%u ivec=%u: handler to data in %s %.1f usec",
+            inum, ivec, toscaDmaSpaceToStr(r->dest),
+            (finished.tv_sec - start.tv_sec) * 1e6 + (finished.tv_nsec - start.tv_nsec) * 1e-3);
+    }
+    if (r->callback)
+        r->callback(r->user, status);
+}
+
+int toscaIntrConnectDma(intrmask_t intrmask, struct dmaRequest* r)
+{
+    if (!r || r->fd <= 0 || (r->flags & FLAG_CLOSE))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    debug("intrmask=0x%016"PRIx64" %s:0x%"PRIx64"->%s:0x%"PRIx64" [0x%x]",
+        intrmask,
+        toscaDmaSpaceToStr(r->source), r->req.src_addr,
+        toscaDmaSpaceToStr(r->dest), r->req.dst_addr,
+        r->req.size);
+    /* Record the device first: a failed connect may have installed the handler on some lines,
+       which toscaDmaRelease must disconnect. */
+    r->intrDevices |= 1U << ((intrmask >> 24) & 31);
+    return toscaIntrConnectHandler(intrmask, toscaDmaIntrHandler, r);
+}
+
+int toscaIntrDisconnectDma(intrmask_t intrmask, struct dmaRequest* r)
+{
+    return toscaIntrDisconnectHandler(intrmask, toscaDmaIntrHandler, r);
+}
+
 static int loopsRunning = 0;
 static int stopLoops = 0;
 
@@ -410,9 +454,23 @@ struct dmaRequest* toscaDmaRequestCreate(void)
 
 void toscaDmaRelease(struct dmaRequest* r)
 {
+    unsigned int device;
+
     if (!r) return;
+    if (r->intrDevices)
+    {
+        /* Still connected to interrupts: disconnect all (vector 0 means any)
+           and let a running handler finish before the request is recycled. */
+        for (device = 0; device < 32; device++)
+            if (r->intrDevices & (1U << device))
+                toscaIntrDisconnectHandler(TOSCA_INTR_ANY|TOSCA_VME_FAIL_ANY|(uint32_t)device<<24,
+                    toscaDmaIntrHandler, r);
+        r->intrDevices = 0;
+        toscaIntrDispatchWait();
+    }
     LOCK;
     if (r->fd > 0) close(r->fd);
+    r->fd = -1;
     if (!r->next)
     {
         debugLvl(4, "put back request %p to freelist, freelist = %p", r, freelist);
@@ -703,3 +761,67 @@ int toscaDmaTransfer(
     r->flags = FLAG_CLOSE;
     return toscaDmaExecute(r);
 }
+
+/* Pinned DMA buffers. We need the size to unmap, so keep a list. */
+struct dmaBuffer
+{
+    void* ptr;
+    size_t size;
+    struct dmaBuffer* next;
+};
+static struct dmaBuffer* dmaBuffers;
+
+void* toscaDmaAlloc(size_t size)
+{
+    struct dmaBuffer* b;
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+
+    if (!size) return NULL;
+    b = malloc(sizeof(struct dmaBuffer));
+    if (!b)
+    {
+        debugErrno("malloc struct dmaBuffer");
+        return NULL;
+    }
+    b->size = (size + pagesize - 1) & ~(pagesize - 1);
+    b->ptr = mmap(NULL, b->size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (b->ptr == MAP_FAILED)
+    {
+        debugErrno("mmap DMA buffer size 0x%zx", b->size);
+        free(b);
+        return NULL;
+    }
+    if (mlock(b->ptr, b->size) != 0)
+        debug("cannot lock DMA buffer %p size 0x%zx in memory: %m", b->ptr, b->size);
+    LOCK;
+    b->next = dmaBuffers;
+    dmaBuffers = b;
+    UNLOCK;
+    debugLvl(2, "%p size 0x%zx", b->ptr, b->size);
+    return b->ptr;
+}
+
+int toscaDmaFree(void* ptr)
+{
+    struct dmaBuffer** pb, *b;
+
+    if (!ptr) return 0;
+    LOCK;
+    for (pb = &dmaBuffers; (b = *pb) != NULL; pb = &b->next)
+        if (b->ptr == ptr)
+        {
+            *pb = b->next;
+            break;
+        }
+    UNLOCK;
+    if (!b)
+    {
+        debug("%p is not a DMA buffer", ptr);
+        errno = EINVAL;
+        return -1;
+    }
+    debugLvl(2, "%p size 0x%zx", b->ptr, b->size);
+    munmap(b->ptr, b->size); /* also unlocks */
+    free(b);
+    return 0;
+}
@@ -2,6 +2,7 @@
 #define toscaDma_h
 
 #include "toscaMap.h"
+#include "toscaIntr.h"
 #include "stdio.h"
 
 /* VME block transfer access modes from vme.h */
@@ -75,6 +76,17 @@ static inline int toscaDmaRead(unsigned int source, uint64_t source_addr, void*
 }
 
 
+int toscaIntrConnectDma(intrmask_t intrmask, struct dmaRequest*);
+/* Executes the DMA request directly in the interrupt handler thread whenever an interrupt in intrmask arrives. */
+/* Saves the hand-over to a DMA loop thread, but the interrupt handler thread is blocked during the transfer. */
+/* The callback of the request (if any) is called after the transfer in the interrupt handler thread. */
+/* Requests created with toscaDmaTransfer cannot be connected. */
+/* Returns 0 on success, -1 on failure. */
+
+int toscaIntrDisconnectDma(intrmask_t intrmask, struct dmaRequest*);
+/* Disconnects a DMA request connected with toscaIntrConnectDma. */
+/* Returns number of disconnected interrupts like toscaIntrDisconnectHandler. */
+
 void* toscaDmaLoop();
 /* Start this function in one or more threads to handle DMA requests with callback */
 
@@ -85,6 +97,16 @@ void toscaDmaLoopsStop();
 /* Terminate all DMA loops. */
 /* Returns after all loops have stopped and no handler is active any more. */
 
+void* toscaDmaAlloc(size_t size);
+/* Allocates a zero filled buffer for DMA transfers, page aligned, size rounded up to full pages. */
+/* The buffer is locked in memory (pinned) if the memlock limit allows, thus the kernel */
+/* does not need to fault in pages during the transfer. */
+/* Returns NULL on failure. */
+
+int toscaDmaFree(void* ptr);
+/* Releases a buffer allocated with toscaDmaAlloc. */
+/* Returns 0 on success (also for NULL) or -1 with errno=EINVAL if ptr is not such a buffer. */
+
 #ifdef __cplusplus
 }
 #endif
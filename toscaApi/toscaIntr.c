@@ -2,7 +2,9 @@
 #define _GNU_SOURCE
 #endif
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -26,6 +28,12 @@
 #define epoll_create1(F) ({int _fd=epoll_create(20); fcntl(_fd, F_SETFD, fcntl(_fd, F_GETFD) | FD_CLOEXEC); _fd; })
 #endif
 
+#ifndef EFD_CLOEXEC
+#define EFD_CLOEXEC 02000000
+#define EFD_NONBLOCK 04000
+#define eventfd(I,F) ({int _fd=eventfd(I,0); fcntl(_fd, F_SETFD, fcntl(_fd, F_GETFD) | FD_CLOEXEC); fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK); _fd; })
+#endif
+
 typedef uint64_t __u64;
 typedef uint32_t __u32;
 typedef uint8_t __u8;
@@ -51,19 +59,63 @@ struct intr_handler {
 };
 
 static int intrFd[TOSCA_NUM_INTR];
-static unsigned long long totalIntrCount, intrCount[TOSCA_NUM_INTR];
 static struct intr_handler* handlers[TOSCA_NUM_INTR];
 
+/* Interrupt counters are only written by toscaIntrLoop.
+   64 bit values cannot be read atomically on 32 bit targets,
+   thus publish them with a sequence counter (seqlock).
+   The sequence is odd while an update is in progress.
+*/
+static unsigned long long totalIntrCount, intrCount[TOSCA_NUM_INTR];
+static volatile unsigned int intrCountSeq;
+
+#define COUNT_UPDATE_BEGIN { intrCountSeq++; __sync_synchronize(); }
+#define COUNT_UPDATE_END { __sync_synchronize(); intrCountSeq++; }
+#define COUNT_READ(action) { unsigned int _seq; \
+    do { while ((_seq = intrCountSeq) & 1); __sync_synchronize(); \
+        action; __sync_synchronize(); } while (_seq != intrCountSeq); }
+
+/* Bitmap of indices with an open intrFd.
+   Most of the TOSCA_NUM_INTR indices are never used,
+   thus iterate only over the active ones.
+*/
+static uint32_t activeIntr[(TOSCA_NUM_INTR+31)/32];
+
+static int toscaIntrNextActive(unsigned int index, unsigned int last)
+{
+    uint32_t bits;
+
+    if (index > last) return -1;
+    bits = activeIntr[index>>5] & (~0U << (index&31));
+    while (!bits)
+    {
+        index = (index|31) + 1;
+        if (index > last) return -1;
+        bits = activeIntr[index>>5];
+    }
+    index = (index & ~31U) + __builtin_ctz(bits);
+    return index <= last ? (int)index : -1;
+}
+
+#define FOREACH_ACTIVE_INDEX(first, last, index) \
+    for (index = toscaIntrNextActive(first, last); index >= 0; index = toscaIntrNextActive(index+1, last))
+
 static int epollfd = -1;
+static pthread_once_t epollOnce = PTHREAD_ONCE_INIT;
 
-void toscaIntrInit () __attribute__((__constructor__));
-void toscaIntrInit ()
+/* Create the epoll fd only in processes which actually use interrupts. */
+static void toscaIntrEpollCreate()
 {
     epollfd = epoll_create1(EPOLL_CLOEXEC);
     if (epollfd < 0)
         debugErrno("epoll_create");
 }
 
+void toscaIntrInit ()
+{
+    pthread_once(&epollOnce, toscaIntrEpollCreate);
+}
+
 #define TOSCA_USER_INTR(n)        TOSCA_USER1_INTR(n)
 #define TOSCA_INTR_DEVICE(m)      (m>>24&&0xff)
 
@@ -96,9 +148,12 @@ void toscaIntrInit ()
     /* handle VME_LVL */                                                                \
     if ((mask) & TOSCA_VME_INTR_ANY) {                                                  \
         unsigned int ivec = TOSCA_INTR_MASK_TO_VEC(mask);                               \
-        if (ivec == 0) do                                                               \
-            FOR_BITS_IN_MASK(1, 7, IX(VME, i, ivec), TOSCA_VME_INTR(i), (mask), action) \
-        while (++ivec <= 255);                                                          \
+        if (ivec == 0) {                                                                \
+            /* all vectors: only those in use matter */                                 \
+            int ix;                                                                     \
+            FOREACH_ACTIVE_INDEX(IX(VME, 1, 0), IX(VME, 7, 255), ix)                    \
+                if ((mask) & INTR_INDEX_TO_BIT(ix)) action(ix, INTR_INDEX_TO_BIT(ix))   \
+        }                                                                               \
         else                                                                            \
             FOR_BITS_IN_MASK(1, 7, IX(VME, i, ivec), TOSCA_VME_INTR(i), (mask), action) \
     }                                                                                   \
@@ -306,11 +361,14 @@ intrmask_t toscaStrToIntrMask(const char* str)
 int toscaIntrMonitorFile(int index, const char* filepattern, ...)
 {
     char* filename = NULL;
+    const char* path;
     struct epoll_event ev;
     va_list ap;
     glob_t globresults;
+    int globbed = 0;
 
     if (intrFd[index] > 0) return 0;
+    toscaIntrInit();
     va_start(ap, filepattern);
     vasprintf(&filename, filepattern, ap);
     va_end(ap);
@@ -319,30 +377,39 @@ int toscaIntrMonitorFile(int index, const char* filepattern, ...)
         debugErrno("%s vasprintf %s", toscaIntrIndexToStr(index), filepattern);
         return -1;
     }
-    debug("%s glob(%s)", toscaIntrIndexToStr(index), filename);
-    if (glob(filename, 0, NULL, &globresults) != 0)
+    path = filename;
+    if (strpbrk(filename, "*?[{"))
     {
-        error("cannot find %s", filename);
-        free(filename);
-        errno = ENOENT;
-        return -1;
+        /* only search file system if really necessary */
+        debug("%s glob(%s)", toscaIntrIndexToStr(index), filename);
+        if (glob(filename, GLOB_BRACE, NULL, &globresults) != 0)
+        {
+            error("cannot find %s", filename);
+            free(filename);
+            errno = ENOENT;
+            return -1;
+        }
+        path = globresults.gl_pathv[0];
+        globbed = 1;
     }
-    free(filename);
-    intrFd[index] = open(globresults.gl_pathv[0], O_RDWR|O_CLOEXEC);
-    debug ("%s open %s intrFd[%d]=%d", toscaIntrIndexToStr(index), globresults.gl_pathv[0], index, intrFd[index]);
+    intrFd[index] = open(path, O_RDWR|O_CLOEXEC);
+    debug ("%s open %s intrFd[%d]=%d", toscaIntrIndexToStr(index), path, index, intrFd[index]);
     if (intrFd[index] < 0)
     {
-        debugErrno("%s open %s", toscaIntrIndexToStr(index), globresults.gl_pathv[0]);
-        globfree(&globresults);
+        debugErrno("%s open %s", toscaIntrIndexToStr(index), path);
+        if (globbed) globfree(&globresults);
+        free(filename);
         return -1;
     }
     ev.events = EPOLLIN;
     ev.data.u32 = index;
     if (epoll_ctl(epollfd, EPOLL_CTL_ADD, intrFd[index], &ev) < 0)
     {
-        debugErrno("epoll_ctl ADD %d %s", intrFd[index], globresults.gl_pathv[0]);
+        debugErrno("epoll_ctl ADD %d %s", intrFd[index], path);
     }
-    globfree(&globresults);
+    if (globbed) globfree(&globresults);
+    free(filename);
+    activeIntr[index>>5] |= 1U << (index&31);
     write(intrFd[index], NULL, 0);  /* enable level interrupts (no-op for edge) */
     return 0;
 }
@@ -550,6 +617,7 @@ size_t toscaIntrForEachHandler(size_t (*callback)(const toscaIntrHandlerInfo_t*,
     toscaIntrHandlerInfo_t info;
     struct intr_handler* handler;
     int status;
+    int index;
 
     #define REPORT_HANDLER(i, bit)                     \
     {                                                  \
@@ -561,22 +629,69 @@ size_t toscaIntrForEachHandler(size_t (*callback)(const toscaIntrHandlerInfo_t*,
             info.vec = INTR_INDEX_TO_IVEC(i);          \
             info.function = handler->function;         \
             info.parameter = handler->parameter;       \
-            info.count = intrCount[i];                 \
+            COUNT_READ(info.count = intrCount[i]);     \
             status = callback(&info, user);            \
             if (status != 0) return status;            \
         }                                              \
     }
-    FOREACH_MASKBIT(TOSCA_INTR_ANY, REPORT_HANDLER);
+    FOREACH_ACTIVE_INDEX(0, TOSCA_NUM_INTR-1, index)
+        REPORT_HANDLER(index, INTR_INDEX_TO_BIT(index));
     return 0;
 }
 
 unsigned long long toscaIntrCount()
 {
-    return totalIntrCount;
+    unsigned long long count;
+    COUNT_READ(count = totalIntrCount);
+    return count;
+}
+
+unsigned long long toscaIntrIndexCount(unsigned int index)
+{
+    unsigned long long count;
+    if (index >= TOSCA_NUM_INTR) return 0;
+    COUNT_READ(count = intrCount[index]);
+    return count;
+}
+
+unsigned long long toscaIntrCountSnapshot(unsigned long long* counts)
+{
+    unsigned long long total;
+    int index;
+
+    if (!counts) return toscaIntrCount();
+    memset(counts, 0, TOSCA_NUM_INTR * sizeof(counts[0]));
+    /* only active indices can count */
+    COUNT_READ(
+        total = totalIntrCount;
+        FOREACH_ACTIVE_INDEX(0, TOSCA_NUM_INTR-1, index)
+            counts[index] = intrCount[index]);
+    return total;
 }
 
 static int toscaIntrLoopRunning = 0;
 static int intrLoopStopEvent[2];
+static pthread_t intrLoopThread;
+
+/* Odd while toscaIntrLoop is calling handlers.
+   Handlers are called without lock, thus after disconnecting a handler
+   wait for the end of the current dispatch before freeing its parameter. */
+static volatile unsigned int intrDispatchSeq;
+
+void toscaIntrDispatchWait(void)
+{
+    unsigned int seq;
+
+    /* order the caller's unlink of the handler before reading the sequence */
+    __sync_synchronize();
+    seq = intrDispatchSeq;
+    if (!(seq & 1) || pthread_equal(pthread_self(), intrLoopThread)) return;
+    while (intrDispatchSeq == seq)
+    {
+        usleep(10);
+        __sync_synchronize();
+    }
+}
 
 void* toscaIntrLoop()
 {
@@ -592,8 +707,10 @@ void* toscaIntrLoop()
         return NULL;
     }
     toscaIntrLoopRunning = 1;
+    intrLoopThread = pthread_self();
 
     debug("starting interrupt handling");
+    toscaIntrInit();
     pipe2(intrLoopStopEvent, O_NONBLOCK|O_CLOEXEC);
 
     events[0].events = EPOLLIN;
@@ -611,6 +728,8 @@ void* toscaIntrLoop()
             error("epoll_wait");
             break;
         }
+        intrDispatchSeq++;
+        __sync_synchronize();
         for (i = 0; i < n; i++)
         {
             struct intr_handler* handler;
@@ -626,8 +745,10 @@ void* toscaIntrLoop()
             }
             inum = INTR_INDEX_TO_INUM(index);
             ivec = INTR_INDEX_TO_IVEC(index);
+            COUNT_UPDATE_BEGIN;
             totalIntrCount++;
             intrCount[index]++;
+            COUNT_UPDATE_END;
             debugLvl(2, "interrupt %llu index=%u inum=%u ivec=%u", totalIntrCount, index, inum, ivec);
             FOREACH_HANDLER(handler, index) {
                 char* fname;
@@ -643,6 +764,8 @@ void* toscaIntrLoop()
             }
             write(intrFd[index], NULL, 0);  /* re-enable level interrupts (no-op for edge) */
         }
+        __sync_synchronize();
+        intrDispatchSeq++;
     }
     debug("interrupt handling ended");
     return NULL;
@@ -712,6 +835,191 @@ int toscaSendVMEIntr(unsigned int level, unsigned int ivec)
     return 0;
 }
 
+/* Blocking interrupt waiters.
+   Each waiter owns a single producer single consumer ring:
+   toscaIntrLoop writes events, the waiter thread reads them.
+   The eventfd is only a doorbell and may be readable without
+   pending events, thus the ring is always checked first.
+*/
+
+#define TOSCA_INTR_WAIT_QUEUE_SIZE 256 /* must be power of 2 */
+
+struct toscaIntrWaiter {
+    intrmask_t intrmask;
+    int fd;
+    volatile unsigned int head;        /* written by toscaIntrLoop only */
+    volatile unsigned int tail;        /* written by the waiter only */
+    unsigned long long lost;           /* written by toscaIntrLoop only */
+    toscaIntrWaitInfo_t queue[TOSCA_INTR_WAIT_QUEUE_SIZE];
+};
+
+static void toscaIntrWaitPut(struct toscaIntrWaiter* waiter, intrmask_t intrmaskbit, unsigned int inum, unsigned int ivec)
+{
+    static const uint64_t one = 1;
+    unsigned int head = waiter->head;
+    toscaIntrWaitInfo_t* info;
+
+    if (head - waiter->tail >= TOSCA_INTR_WAIT_QUEUE_SIZE)
+    {
+        debugLvl(2, "waiter %p queue full", waiter);
+        waiter->lost++;
+        return;
+    }
+    info = &waiter->queue[head & (TOSCA_INTR_WAIT_QUEUE_SIZE-1)];
+    info->intrmaskbit = intrmaskbit;
+    info->inum = inum;
+    info->ivec = ivec;
+    info->lost = waiter->lost;
+    waiter->lost = 0;
+    __sync_synchronize();
+    waiter->head = head + 1;
+    if (write(waiter->fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        debugErrno("write eventfd %d", waiter->fd);
+}
+
+static void toscaIntrWaitUserHandler(struct toscaIntrWaiter* waiter, unsigned int inum, unsigned int ivec)
+{
+    toscaIntrWaitPut(waiter, TOSCA_USER_INTR(inum), inum, ivec);
+}
+
+static void toscaIntrWaitVmeHandler(struct toscaIntrWaiter* waiter, unsigned int inum, unsigned int ivec)
+{
+    toscaIntrWaitPut(waiter, TOSCA_VME_INTR(inum), inum, ivec);
+}
+
+static void toscaIntrWaitFailHandler(struct toscaIntrWaiter* waiter, unsigned int inum, unsigned int ivec)
+{
+    toscaIntrWaitPut(waiter, TOSCA_VME_FAIL(inum), inum, ivec);
+}
+
+#define TOSCA_INTR_WAIT_USER_MASK(m) ((m) & (TOSCA_USER_INTR_ANY|0xff000000ULL))
+#define TOSCA_INTR_WAIT_VME_MASK(m)  ((m) & (TOSCA_VME_INTR_ANY|0xffff0000ULL))
+#define TOSCA_INTR_WAIT_FAIL_MASK(m) ((m) & (TOSCA_VME_FAIL_ANY|0xff000000ULL))
+
+static void toscaIntrWaitDisconnect(struct toscaIntrWaiter* waiter)
+{
+    intrmask_t intrmask = waiter->intrmask;
+
+    if (intrmask & TOSCA_USER_INTR_ANY)
+        toscaIntrDisconnectHandler(TOSCA_INTR_WAIT_USER_MASK(intrmask), toscaIntrWaitUserHandler, waiter);
+    if (intrmask & TOSCA_VME_INTR_ANY)
+        toscaIntrDisconnectHandler(TOSCA_INTR_WAIT_VME_MASK(intrmask), toscaIntrWaitVmeHandler, waiter);
+    if (intrmask & TOSCA_VME_FAIL_ANY)
+        toscaIntrDisconnectHandler(TOSCA_INTR_WAIT_FAIL_MASK(intrmask), toscaIntrWaitFailHandler, waiter);
+}
+
+struct toscaIntrWaiter* toscaIntrWaitCreate(intrmask_t intrmask)
+{
+    struct toscaIntrWaiter* waiter;
+    int status = 0;
+
+    debug("intrmask=0x%016"PRIx64, intrmask);
+
+    if (!(intrmask & (TOSCA_USER_INTR_ANY|TOSCA_VME_INTR_ANY|TOSCA_VME_FAIL_ANY)))
+    {
+        error("empty interrupt mask");
+        errno = EINVAL;
+        return NULL;
+    }
+    waiter = calloc(1, sizeof(struct toscaIntrWaiter));
+    if (!waiter)
+    {
+        debugErrno("calloc");
+        return NULL;
+    }
+    waiter->intrmask = intrmask;
+    waiter->fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (waiter->fd < 0)
+    {
+        debugErrno("eventfd");
+        free(waiter);
+        return NULL;
+    }
+    if (intrmask & TOSCA_USER_INTR_ANY)
+        status |= toscaIntrConnectHandler(TOSCA_INTR_WAIT_USER_MASK(intrmask), toscaIntrWaitUserHandler, waiter);
+    if (intrmask & TOSCA_VME_INTR_ANY)
+        status |= toscaIntrConnectHandler(TOSCA_INTR_WAIT_VME_MASK(intrmask), toscaIntrWaitVmeHandler, waiter);
+    if (intrmask & TOSCA_VME_FAIL_ANY)
+        status |= toscaIntrConnectHandler(TOSCA_INTR_WAIT_FAIL_MASK(intrmask), toscaIntrWaitFailHandler, waiter);
+    if (status != 0)
+    {
+        int e = errno;
+        toscaIntrWaitDisconnect(waiter);
+        toscaIntrDispatchWait();
+        close(waiter->fd);
+        free(waiter);
+        errno = e;
+        return NULL;
+    }
+    debug("waiter=%p fd=%d", waiter, waiter->fd);
+    return waiter;
+}
+
+int toscaIntrWait(struct toscaIntrWaiter* waiter, int timeout, toscaIntrWaitInfo_t* info)
+{
+    uint64_t n;
+    struct pollfd pfd;
+    unsigned int tail;
+
+    if (!waiter)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    pfd.fd = waiter->fd;
+    pfd.events = POLLIN;
+    tail = waiter->tail;
+    while (waiter->head == tail)
+    {
+        /* reset doorbell, then check ring again before sleeping */
+        if (read(waiter->fd, &n, sizeof(n)) > 0) continue;
+        if (errno != EAGAIN)
+        {
+            debugErrno("read eventfd %d", waiter->fd);
+            return -1;
+        }
+        if (timeout == 0) return -1;
+        switch (poll(&pfd, 1, timeout))
+        {
+            case 1:
+                continue;
+            case 0:
+                errno = ETIMEDOUT;
+                return -1;
+            default:
+                if (errno == EINTR) continue;
+                debugErrno("poll eventfd %d", waiter->fd);
+                return -1;
+        }
+    }
+    __sync_synchronize();
+    if (info) *info = waiter->queue[tail & (TOSCA_INTR_WAIT_QUEUE_SIZE-1)];
+    __sync_synchronize();
+    waiter->tail = tail + 1;
+    return 0;
+}
+
+int toscaIntrWaitFd(struct toscaIntrWaiter* waiter)
+{
+    if (!waiter)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return waiter->fd;
+}
+
+void toscaIntrWaitRelease(struct toscaIntrWaiter* waiter)
+{
+    if (!waiter) return;
+    debug("waiter=%p fd=%d", waiter, waiter->fd);
+    toscaIntrWaitDisconnect(waiter);
+    /* toscaIntrLoop may still be in toscaIntrWaitPut with this waiter. */
+    toscaIntrDispatchWait();
+    close(waiter->fd);
+    free(waiter);
+}
+
 void toscaSpuriousVMEInterruptHandler(void* param, unsigned int inum, unsigned int ivec)
 {
     unsigned int device = (unsigned int)(size_t)param;
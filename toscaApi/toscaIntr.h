@@ -86,6 +86,11 @@ void* toscaIntrLoop();
 int toscaIntrLoopIsRunning(void);
 /* Returns 1 if the toscaIntrLoop is already running, else 0. */
 
+void toscaIntrDispatchWait(void);
+/* Handlers are called without lock. After disconnecting a handler, call this */
+/* before freeing its parameter. Waits until toscaIntrLoop has finished calling */
+/* the handlers of the current interrupts (returns immediately in the loop thread). */
+
 void toscaIntrLoopStop();
 /* Terminate the interrupt loop. */
 /* Returns after loop has stopped and no handler is active any more. */
@@ -108,6 +113,38 @@ size_t toscaIntrForEachHandler(size_t (*callback)(const toscaIntrHandlerInfo_t*
 unsigned long long toscaIntrCount();
 /* Returns total number of interrupts received by toscaIntrLoop since start of this API. */
 
+unsigned long long toscaIntrIndexCount(unsigned int index);
+/* Returns number of interrupts received for one index (see toscaIntrHandlerInfo_t). */
+
+unsigned long long toscaIntrCountSnapshot(unsigned long long* counts);
+/* Fills counts[TOSCA_NUM_INTR] (if not NULL) with a consistent snapshot of all counters by index. */
+/* Returns the total count of the same snapshot. */
+/* All counters are safe to read from any thread. */
+
+typedef struct {
+    intrmask_t intrmaskbit;    /* one of the mask bits (without device and vector) */
+    unsigned int inum;         /* interrupt number as passed to handler functions */
+    unsigned int ivec;         /* interrupt vector as passed to handler functions */
+    unsigned long long lost;   /* number of events dropped before this one because the queue was full */
+} toscaIntrWaitInfo_t;
+
+struct toscaIntrWaiter* toscaIntrWaitCreate(intrmask_t intrmask);
+/* Creates a waiter object receiving all interrupts in intrmask. */
+/* Interrupts are queued from the moment of creation. */
+/* Returns NULL on failure. */
+
+int toscaIntrWait(struct toscaIntrWaiter* waiter, int timeout, toscaIntrWaitInfo_t* info);
+/* Waits up to timeout milliseconds for the next queued interrupt and fills info (may be NULL). */
+/* timeout < 0 waits forever, timeout = 0 only checks the queue. */
+/* Returns 0 on success, -1 on failure with errno = ETIMEDOUT or EAGAIN (when timeout = 0). */
+
+int toscaIntrWaitFd(struct toscaIntrWaiter* waiter);
+/* Returns a file descriptor which is readable when interrupts may be queued (for poll, epoll, select). */
+/* Do not read from it but call toscaIntrWait with timeout 0 until it fails. */
+
+void toscaIntrWaitRelease(struct toscaIntrWaiter* waiter);
+/* Disconnects the waiter and releases all resources. */
+
 int toscaSendVMEIntr(unsigned int level, unsigned int vec);
 /* Generates an interrupt on the VME bus. */
 
@@ -13,12 +13,20 @@
 #include <stdlib.h>
 #include <glob.h>
 #include <inttypes.h>
+#include <limits.h>
 
 #ifndef O_CLOEXEC
 #define O_CLOEXEC 02000000
 #define open(path,flags) ({int _fd=open(path,(flags)&~O_CLOEXEC); if ((flags)&O_CLOEXEC) fcntl(_fd, F_SETFD, fcntl(_fd, F_GETFD)|FD_CLOEXEC); _fd; })
 #endif
 
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0x8000
+#endif
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+
 #include "sysfs.h"
 #include "toscaMap.h"
 typedef uint64_t __u64;
@@ -32,19 +40,38 @@ typedef uint8_t __u8;
 /* Tosca tries to re-use mapping windows if possible.
  * Unfortunately mmap does not re-use mappings.
  * We need to keep our own list.
+ *
+ * Each successful toscaMap() call takes a reference which toscaUnmap() releases.
+ * Lookup is lock free. Thus released maps are unlinked but their list nodes are
+ * never freed, only recycled, and a map is only valid while refcount is not MAP_DEAD.
+ * Callers which never call toscaUnmap() (most of them) drive refcount up to
+ * MAP_PINNED where it sticks and the map can never be released.
  */
 
+#define MAP_DEAD   0xffffffffU
+#define MAP_PINNED 0xfffffffeU
+
 struct map {
     toscaMapInfo_t info;
     struct map *next;
+    unsigned int refcount;
+    unsigned long lastuse;
+    int fd;
+    struct vme_master window; /* enabled VME master window or enable=0 */
 };
 
+int toscaMapEvict = 0;
+int toscaMapCoalesce = 0;
+int toscaMapPopulate = 0;
+int toscaMapAlign = 0;
+static unsigned long mapUseCount;
+
 static struct toscaDevice {
     unsigned int dom:16;
     unsigned int bus:8;
     unsigned int dev:5;
     unsigned int func:3;
-    struct map *maps, *csr, *io, *sram;
+    struct map *maps, *csr, *io, *sram, *deadmaps;
     pthread_mutex_t maplist_mutex;
     unsigned int type;  /* 0x1210, 0x1211 = Tosca, 0x1001 = Althea */
     unsigned int bridgenum;
@@ -59,10 +86,13 @@ IFC1410: device 0 (0x1410): TCSR, TIO, USER1, USER2, SHM1, SHM2
 
 */
 
+void toscaInit();
+
 static unsigned int driverVersion = 0;
 
 unsigned int toscaDriverVersion()
 {
+    toscaInit();
     return driverVersion;
 }
 
@@ -70,13 +100,16 @@ static unsigned int numDevices = 0;
 
 unsigned int toscaNumDevices()
 {
+    toscaInit();
     return numDevices;
 }
 
 #define TOSCA_PCI_DIR "/sys/bus/pci/drivers/tosca"
 
-void toscaInit() __attribute__((__constructor__));
-void toscaInit()
+/* Device discovery runs on first use, not in every process linking the library. */
+static pthread_once_t toscaInitOnce = PTHREAD_ONCE_INIT;
+
+static void toscaDiscover()
 {
     glob_t globresults;
     int status;
@@ -105,7 +138,14 @@ void toscaInit()
         toscaDevices[i].bus = bus;
         toscaDevices[i].dev = dev;
         toscaDevices[i].func = func;
-        pthread_mutex_init(&toscaDevices[i].maplist_mutex, NULL);
+        {
+            /* toscaMapForEach callbacks may call toscaMap */
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+            pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+            pthread_mutex_init(&toscaDevices[i].maplist_mutex, &attr);
+            pthread_mutexattr_destroy(&attr);
+        }
 
         sprintf(filename, "%s/device", globresults.gl_pathv[i]);
         fd = open(filename, O_RDONLY|O_CLOEXEC);
@@ -130,10 +170,87 @@ void toscaInit()
     globfree(&globresults);
 }
 
+void toscaInit()
+{
+    pthread_once(&toscaInitOnce, toscaDiscover);
+}
+
+/* All UIO devices of platform devices, found with one sysfs scan on first use. */
+static struct uioDevice {
+    char* name;      /* platform device name suffix, e.g. "sram" */
+    char uio[16];    /* e.g. "uio0" */
+    size_t size;     /* size of map0 */
+} *uioDevices;
+static size_t numUioDevices;
+static pthread_once_t uioScanOnce = PTHREAD_ONCE_INIT;
+
+static void toscaUioScan()
+{
+    glob_t globresults;
+    size_t i;
+
+    debug("glob(/sys/bus/platform/devices/*/uio/uio*)");
+    if (glob("/sys/bus/platform/devices/*/uio/uio*", GLOB_ONLYDIR, NULL, &globresults) != 0)
+    {
+        debug("no UIO devices found");
+        return;
+    }
+    uioDevices = calloc(globresults.gl_pathc, sizeof(struct uioDevice));
+    if (!uioDevices)
+    {
+        globfree(&globresults);
+        return;
+    }
+    for (i = 0; i < globresults.gl_pathc; i++)
+    {
+        char* path = globresults.gl_pathv[i];
+        char* uio = strrchr(path, '/') + 1;
+        char* name;
+        char filename[PATH_MAX];
+        int fd;
+
+        snprintf(filename, sizeof(filename), "%s/maps/map0/size", path);
+        fd = open(filename, O_RDONLY|O_CLOEXEC);
+        if (fd >= 0)
+        {
+            uioDevices[numUioDevices].size = sysfsReadULong(fd);
+            close(fd);
+        }
+        strncpy(uioDevices[numUioDevices].uio, uio, sizeof(uioDevices[0].uio)-1);
+        *strstr(path, "/uio/") = 0;
+        name = strrchr(path, '.');
+        if (!name) name = strrchr(path, '/');
+        uioDevices[numUioDevices].name = strdup(name + 1);
+        debug("found UIO device %s for %s size 0x%zx", uioDevices[numUioDevices].uio, path,
+            uioDevices[numUioDevices].size);
+        numUioDevices++;
+    }
+    globfree(&globresults);
+}
+
+const char* toscaUioDevice(const char* name, size_t* size)
+{
+    size_t i;
+
+    pthread_once(&uioScanOnce, toscaUioScan);
+    for (i = 0; i < numUioDevices; i++)
+    {
+        if (uioDevices[i].name && strcmp(uioDevices[i].name, name) == 0)
+        {
+            if (size) *size = uioDevices[i].size;
+            return uioDevices[i].uio;
+        }
+    }
+    debug("no UIO device for %s", name);
+    errno = ENODEV;
+    return NULL;
+}
+
 unsigned int toscaListDevices()
 {
     unsigned int i;
 
+    toscaInit();
     printf("tosca driverVersion=%u\n", driverVersion);
     for (i = 0; i < numDevices; i++)
     {
@@ -146,6 +263,7 @@ unsigned int toscaListDevices()
 
 unsigned int toscaDeviceType(unsigned int device)
 {
+    toscaInit();
     if (device < numDevices)
         return toscaDevices[device].type;
     errno = ENODEV;
@@ -158,6 +276,7 @@ int toscaOpen(unsigned int device, const char* resource)
     char filename[80];
 
     debug("device=%u resource=%s", device, resource);
+    toscaInit();
     if (device >= numDevices)
     {
         error("device=%u but only %u tosca devices found", device, numDevices);
@@ -391,6 +510,167 @@ toscaMapAddr_t toscaStrToAddr(const char* str, const char** end)
     return result;
 }
 
+/* Reserve address space aligned to align (power of 2) for a MAP_FIXED mmap,
+   so that the kernel can use huge page table entries for large windows. */
+static void* toscaMapReserveAligned(size_t size, size_t align)
+{
+    char *reserved, *aligned;
+
+    if (align & (align - 1))
+    {
+        error("toscaMapAlign 0x%zx is not a power of 2", align);
+        return NULL;
+    }
+    reserved = mmap(NULL, size + align, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED)
+    {
+        debugErrno("mmap reserve 0x%zx", size + align);
+        return NULL;
+    }
+    aligned = (char*)(((size_t)reserved + align - 1) & ~(align - 1));
+    if (aligned > reserved) munmap(reserved, aligned - reserved);
+    munmap(aligned + size, reserved + align - aligned);
+    debug("reserved %p size 0x%zx aligned to 0x%zx", aligned, size, align);
+    return aligned;
+}
+
+static int toscaMapMatch(struct map* map, unsigned int addrspace, uint64_t address, size_t size)
+{
+    return addrspace == map->info.addrspace &&
+        address >= map->info.baseaddress &&
+        address + size <= map->info.baseaddress + map->info.size;
+}
+
+static int toscaMapGet(struct map* map)
+{
+    unsigned int r;
+
+    do {
+        r = map->refcount;
+        if (r == MAP_DEAD) return 0;
+        if (r == MAP_PINNED) return 1;
+    } while (!__sync_bool_compare_and_swap(&map->refcount, r, r + 1));
+    map->lastuse = ++mapUseCount; /* no need to be exact */
+    return 1;
+}
+
+/* Must be called with maplist_mutex locked. */
+static int toscaMapDestroy(unsigned int device, struct map* map)
+{
+    struct map** pmap;
+
+    if (!__sync_bool_compare_and_swap(&map->refcount, 0, MAP_DEAD))
+        return -1; /* in use again */
+    for (pmap = &toscaDevices[device].maps; *pmap && *pmap != map; pmap = &(*pmap)->next);
+    if (*pmap) *pmap = map->next; /* Keep map->next for lock free readers. */
+    debug("%s:0x%"PRIx64"[0x%zx]", toscaAddrSpaceToStr(map->info.addrspace),
+        map->info.baseaddress, map->info.size);
+    if ((map->info.addrspace & 0xfe0) <= VME_SLAVE)
+        munmap((void*)map->info.baseptr, map->info.size);
+    if (map->window.enable)
+    {
+        struct map* other;
+
+        /* Another live map may use the same window (e.g. with a different VME_SWAP flag).
+           Leave the window to that map instead of disabling it under its feet. */
+        for (other = toscaDevices[device].maps; other; other = other->next)
+        {
+            if (other->refcount == MAP_DEAD || !(other->info.addrspace & map->info.addrspace & 0x1f))
+                continue;
+            if (other->info.baseaddress < map->window.vme_addr + map->window.size &&
+                other->info.baseaddress + other->info.size > map->window.vme_addr)
+                break;
+        }
+        if (other)
+        {
+            debug("window address=0x%"PRIx64" size=0x%"PRIx64" still in use",
+                map->window.vme_addr, map->window.size);
+            if (!other->window.enable)
+                other->window = map->window;
+            map->window.enable = 0;
+        }
+    }
+    if (map->window.enable)
+    {
+        map->window.enable = 0;
+        if (ioctl(map->fd, VME_SET_MASTER, &map->window) != 0)
+            debugErrno("ioctl(%d, VME_SET_MASTER, {enable=0 addr=0x%"PRIx64" size=0x%"PRIx64"})",
+                map->fd, map->window.vme_addr, map->window.size);
+    }
+    close(map->fd);
+    /* Lock free readers still in this map end up in the dead list, miss and retry with lock. */
+    map->next = toscaDevices[device].deadmaps;
+    toscaDevices[device].deadmaps = map;
+    return 0;
+}
+
+static void toscaMapPut(unsigned int device, struct map* map)
+{
+    unsigned int r;
+
+    do {
+        r = map->refcount;
+        if (r == MAP_PINNED || r == MAP_DEAD || r == 0) return;
+    } while (!__sync_bool_compare_and_swap(&map->refcount, r, r - 1));
+    if (r == 1 && !toscaMapEvict)
+    {
+        pthread_mutex_lock(&toscaDevices[device].maplist_mutex);
+        toscaMapDestroy(device, map);
+        pthread_mutex_unlock(&toscaDevices[device].maplist_mutex);
+    }
+}
+
+/* Must be called with maplist_mutex locked. */
+static int toscaMapEvictLru(unsigned int device)
+{
+    struct map *map, *lru = NULL;
+
+    for (map = toscaDevices[device].maps; map; map = map->next)
+        if (map->refcount == 0 && map->window.enable && (!lru || (long)(map->lastuse - lru->lastuse) < 0))
+            lru = map;
+    if (!lru)
+    {
+        debug("no idle map to evict");
+        return -1;
+    }
+    debug("evict %s:0x%"PRIx64"[0x%zx]", toscaAddrSpaceToStr(lru->info.addrspace),
+        lru->info.baseaddress, lru->info.size);
+    return toscaMapDestroy(device, lru);
+}
+
+int toscaUnmap(volatile void* ptr)
+{
+    struct map *map;
+    unsigned int device;
+
+    toscaInit();
+    for (device = 0; device < numDevices; device++)
+    {
+        pthread_mutex_lock(&toscaDevices[device].maplist_mutex);
+        for (map = toscaDevices[device].maps; map; map = map->next)
+        {
+            if ((map->info.addrspace & 0xfe0) > VME_SLAVE) continue;
+            if (ptr >= map->info.baseptr && ptr < map->info.baseptr + map->info.size)
+            {
+                if (map->refcount == 0)
+                {
+                    pthread_mutex_unlock(&toscaDevices[device].maplist_mutex);
+                    debug("%p is not mapped", ptr);
+                    errno = EINVAL;
+                    return -1;
+                }
+                toscaMapPut(device, map);
+                pthread_mutex_unlock(&toscaDevices[device].maplist_mutex);
+                return 0;
+            }
+        }
+        pthread_mutex_unlock(&toscaDevices[device].maplist_mutex);
+    }
+    debug("%p is not a Tosca map", ptr);
+    errno = EINVAL;
+    return -1;
+}
+
 volatile void* toscaMap(unsigned int addrspace, uint64_t address, size_t size, uint64_t res_address)
 {
     struct map **pmap, *map;
@@ -399,6 +679,9 @@ volatile void* toscaMap(unsigned int addrspace, uint64_t address, size_t size, u
     int fd = -1;
     unsigned int device;
     unsigned int setcmd, getcmd;
+    struct vme_master window = {0,0,0,0,0,0};
+    uint64_t setaddr, setsize;
+    int locked;
     char filename[80];
 
     device = addrspace >> 16;
@@ -412,6 +695,7 @@ volatile void* toscaMap(unsigned int addrspace, uint64_t address, size_t size, u
         address,
         size);
 
+    toscaInit();
     if (device >= numDevices)
     {
         debug("device %u does not exist", device);
@@ -435,9 +719,10 @@ volatile void* toscaMap(unsigned int addrspace, uint64_t address, size_t size, u
         return map->info.baseptr + address;
     }
 */
-    /* Lookup can be lock free because we only ever append to list. */
-    pmap = &toscaDevices[device].maps;
+    /* Lookup is lock free. Check again with lock before creating a new map. */
+    locked = 0;
 check_existing_maps:
+    pmap = &toscaDevices[device].maps;
     while ((map = *pmap) != NULL)
     {
         debug("%u:%s:0x%"PRIx64"[0x%zx] check addrspace=0x%x(%s):0x%"PRIx64"[0x%zx]",
@@ -446,10 +731,16 @@ check_existing_maps:
             toscaAddrSpaceToStr(map->info.addrspace),
             map->info.baseaddress,
             map->info.size);
-        if (addrspace == map->info.addrspace &&
-            address >= map->info.baseaddress &&
-            address + size <= map->info.baseaddress + map->info.size)
+        if (toscaMapMatch(map, addrspace, address, size) && toscaMapGet(map))
         {
+            if (!toscaMapMatch(map, addrspace, address, size))
+            {
+                /* Map has been recycled meanwhile. */
+                toscaMapPut(device, map);
+                pmap = &map->next;
+                continue;
+            }
+            if (locked) pthread_mutex_unlock(&toscaDevices[device].maplist_mutex);
             if ((addrspace & 0xfe0) > VME_SLAVE)
             {
                 /* Existing VME slave to Tosca resource: Check resource address. */
@@ -472,11 +763,11 @@ check_existing_maps:
     }
 
     /* No matching map found. Serialize creating new maps. */
-    pthread_mutex_lock(&toscaDevices[device].maplist_mutex);
-    if (*pmap != NULL)
+    if (!locked)
     {
-        /* New maps have been added while we were sleeping, maybe the one we need? */
-        pthread_mutex_unlock(&toscaDevices[device].maplist_mutex);
+        /* New maps may have been added while we were sleeping, maybe the one we need? */
+        pthread_mutex_lock(&toscaDevices[device].maplist_mutex);
+        locked = 1;
         goto check_existing_maps;
     }
 
@@ -505,10 +796,7 @@ check_existing_maps:
     }
     else if (addrspace & TOSCA_SRAM)
     {
-        glob_t globresults;
-        ssize_t n;
-        char* uiodev;
-        char buffer[24];
+        const char* uiodev;
 
         if (device != 0)
         {
@@ -517,37 +805,17 @@ check_existing_maps:
             goto fail;
         }
 
-        sprintf(filename, "/sys/bus/platform/devices/*.sram/uio/uio*/maps/map0/size");
-        debug("glob(%s)", filename);
-        if (glob(filename, GLOB_ONLYDIR, NULL, &globresults) != 0)
+        uiodev = toscaUioDevice("sram", &mapsize); /* Map whole SRAM. */
+        if (!uiodev)
         {
             debug("cannot find SRAM device");
-            errno = ENODEV;
-            goto fail;
-        }
-        fd = open(globresults.gl_pathv[0], O_RDONLY|O_CLOEXEC);
-        if (fd < 0)
-        {
-            debugErrno("open %s", filename);
-            goto fail;
-        }
-        n = read(fd, buffer, sizeof(buffer)-1);
-        if (n < 0)
-        {
-            debugErrno("cannot read %s", filename);
             goto fail;
         }
-        close(fd);
-        if (n >= 0) buffer[n] = 0;
-        mapsize = strtoul(buffer, NULL, 0); /* Map whole SRAM. */
         offset = address;
         address = 0;
-        uiodev = strstr(globresults.gl_pathv[0], "/uio/") + 5;
-        *strchr(uiodev, '/') = 0;
-        debug ("found SRAM device %s size %s", uiodev, buffer);
+        debug ("found SRAM device %s size 0x%zx", uiodev, mapsize);
         sprintf(filename, "/dev/%s", uiodev);
         fd = open(filename, O_RDWR|O_CLOEXEC);
-        globfree(&globresults);
         if (fd < 0)
         {
             debugErrno("open %s", filename);
@@ -557,6 +825,7 @@ check_existing_maps:
     else if (addrspace & (VME_A16|VME_A24|VME_A32|VME_A64|VME_CRCSR|VME_SLAVE|TOSCA_USER1|TOSCA_USER2|TOSCA_SMEM1|TOSCA_SMEM2))
     {
         struct vme_slave vme_window = {0,0,0,0,0,0};
+        struct vme_slave exact_window = {0,0,0,0,0,0};
 
         if (size == (size_t)-1)
         {
@@ -637,6 +906,26 @@ check_existing_maps:
             setcmd = VME_SET_MASTER;
             getcmd = VME_GET_MASTER;
             vme_window.aspace = addrspace & 0x0fff;
+
+            if ((addrspace & VME_A32) && toscaMapCoalesce > 0)
+            {
+                /* Place A32 windows on a grid of toscaMapCoalesce MB.
+                   Later nearby requests then fit into this window
+                   instead of creating many small windows. */
+                uint64_t grid = (uint64_t)toscaMapCoalesce << 20;
+                uint64_t start = address - address % grid;
+                uint64_t end = address + size + grid - 1;
+                end -= end % grid;
+                if (end > 0x100000000LL) end = 0x100000000LL;
+                if (end - start > vme_window.size)
+                {
+                    exact_window = vme_window;
+                    vme_window.vme_addr = start;
+                    vme_window.size = end - start;
+                    debug("coalesced window address=0x%"PRIx64" size=0x%"PRIx64,
+                        vme_window.vme_addr, vme_window.size);
+                }
+            }
         }
 
         fd = open(filename, O_RDWR|O_CLOEXEC);
@@ -646,8 +935,18 @@ check_existing_maps:
             goto fail;
         }
 
-        if (ioctl(fd, setcmd, &vme_window) != 0)
+        while (ioctl(fd, setcmd, &vme_window) != 0)
         {
+            if (exact_window.enable)
+            {
+                /* Enlarged window failed. Try what was requested. */
+                debug("coalesced window failed: %m");
+                vme_window = exact_window;
+                exact_window.enable = 0;
+                continue;
+            }
+            if (setcmd == VME_SET_MASTER && toscaMapEvict && errno != EINVAL && toscaMapEvictLru(device) == 0)
+                continue;
             if (setcmd == VME_SET_SLAVE && errno == ENODEV)
             {
                 debug("overlap with existing SLAVE map");
@@ -664,6 +963,8 @@ check_existing_maps:
             goto fail;
         }
 
+        setaddr = vme_window.vme_addr;
+        setsize = vme_window.size;
         if (getcmd)
         {
             /* If the request fits into an existing window,
@@ -681,6 +982,16 @@ check_existing_maps:
                 vme_window.size);
         }
         res_address = vme_window.resource_offset;
+        if (setcmd == VME_SET_MASTER && vme_window.vme_addr == setaddr && vme_window.size == setsize)
+        {
+            /* Only a window created for this map is owned and disabled when the map is destroyed,
+               not an existing window that may be shared with other maps or processes. */
+            window.enable = 1;
+            window.vme_addr = vme_window.vme_addr;
+            window.size = vme_window.size;
+            window.aspace = vme_window.aspace;
+            window.cycle = vme_window.cycle;
+        }
 
         /* Find the MMU pages in the window we need to map. */
         offset = address - vme_window.vme_addr;   /* Location within window that maps to requested address */
@@ -704,28 +1015,54 @@ check_existing_maps:
     }
     else
     {
-        baseptr = mmap((void*)(size_t) res_address, mapsize, PROT_READ | PROT_WRITE, res_address ? MAP_PRIVATE | MAP_FIXED : MAP_SHARED, fd, 0);
-        debug("mmap(%p, size=0x%zx, PROT_READ | PROT_WRITE, %s, %s, 0) = %p",
-            (void*)(size_t) res_address, mapsize, res_address ? "MAP_PRIVATE | MAP_FIXED" : "MAP_SHARED", filename, baseptr);
+        void* hint = (void*)(size_t) res_address;
+        int flags = res_address ? MAP_PRIVATE | MAP_FIXED : MAP_SHARED;
+
+        if (toscaMapPopulate) flags |= MAP_POPULATE;
+        if (!res_address && toscaMapAlign > 0 && mapsize >= (size_t)toscaMapAlign)
+        {
+            hint = toscaMapReserveAligned(mapsize, toscaMapAlign);
+            if (hint) flags |= MAP_FIXED;
+        }
+        baseptr = mmap(hint, mapsize, PROT_READ | PROT_WRITE, flags, fd, 0);
+        debug("mmap(%p, size=0x%zx, PROT_READ | PROT_WRITE, %s%s%s, %s, 0) = %p",
+            hint, mapsize, flags & MAP_PRIVATE ? "MAP_PRIVATE" : "MAP_SHARED",
+            flags & MAP_FIXED ? " | MAP_FIXED" : "", flags & MAP_POPULATE ? " | MAP_POPULATE" : "",
+            filename, baseptr);
         if (baseptr == MAP_FAILED || baseptr == NULL)
         {
             debugErrno("mmap");
+            if (hint && !res_address) munmap(hint, mapsize); /* release reservation */
             goto fail;
         }
     }
 
-    /* Fill in map info and append to list. */
-    map = malloc(sizeof(struct map));
-    if (!map)
+    /* Fill in map info and append to list. Recycle dead map if possible. */
+    map = toscaDevices[device].deadmaps;
+    if (map)
+        toscaDevices[device].deadmaps = map->next;
+    else
     {
-        debugErrno("malloc");
-        goto fail;
+        map = malloc(sizeof(struct map));
+        if (!map)
+        {
+            debugErrno("malloc");
+            goto fail;
+        }
+        map->refcount = MAP_DEAD;
     }
     map->info.addrspace = addrspace | (device << 16);
     map->info.baseaddress = address;
     map->info.size = mapsize;
     map->info.baseptr = baseptr;
+    map->fd = fd;
+    map->window = window;
+    map->lastuse = ++mapUseCount;
     map->next = NULL;
+    /* Slave windows cannot be read back and thus are never released. */
+    __sync_synchronize();
+    map->refcount = addrspace & VME_SLAVE ? MAP_PINNED : 1;
+    __sync_synchronize();
     *pmap = map;
 
     pthread_mutex_unlock(&toscaDevices[device].maplist_mutex);
@@ -747,6 +1084,7 @@ check_existing_maps:
         debug("address 0x%"PRIx64" + size 0x%zx exceeds %s address space size 0x%zx",
             address + offset, size,
             toscaAddrSpaceToStr(addrspace), mapsize);
+        toscaMapPut(device, map);
         errno = EFAULT;
         return NULL;
     }
@@ -767,16 +1105,152 @@ toscaMapInfo_t toscaMapForEach(int(*func)(toscaMapInfo_t info, void* usr), void*
 {
     struct map *map;
     unsigned int device;
+    toscaMapInfo_t info = {0,0,0,0};
 
+    toscaInit();
     for (device = 0; device < numDevices; device++)
     {
+        /* Lock against unmapping. */
+        pthread_mutex_lock(&toscaDevices[device].maplist_mutex);
         for (map = toscaDevices[device].maps; map; map = map->next)
         {
             if (func(map->info, usr) != 0) break; /* loop until user func returns non 0 */
         }
-        if (map) return map->info;        /* info of map where user func returned non 0 */
+        if (map) info = map->info;        /* info of map where user func returned non 0 */
+        pthread_mutex_unlock(&toscaDevices[device].maplist_mutex);
+        if (map) break;
+    }
+    return info;
+}
+
+static struct mapPlan {
+    unsigned int addrspace;
+    uint64_t address;
+    size_t size;
+} *mapPlan;
+static size_t mapPlanCount, mapPlanCapacity;
+static pthread_mutex_t mapPlanMutex = PTHREAD_MUTEX_INITIALIZER;
+
+int toscaMapPlanAdd(unsigned int addrspace, uint64_t address, size_t size)
+{
+    if (addrspace & VME_SLAVE)
+    {
+        error("slave maps cannot be planned");
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&mapPlanMutex);
+    if (mapPlanCount == mapPlanCapacity)
+    {
+        struct mapPlan* p = realloc(mapPlan, (mapPlanCapacity + 16) * sizeof(struct mapPlan));
+        if (!p)
+        {
+            pthread_mutex_unlock(&mapPlanMutex);
+            debugErrno("realloc");
+            return -1;
+        }
+        mapPlan = p;
+        mapPlanCapacity += 16;
     }
-    return (toscaMapInfo_t) {0,0,0,0};
+    mapPlan[mapPlanCount].addrspace = addrspace;
+    mapPlan[mapPlanCount].address = address;
+    mapPlan[mapPlanCount].size = size ? size : 1;
+    mapPlanCount++;
+    pthread_mutex_unlock(&mapPlanMutex);
+    return 0;
+}
+
+static int toscaMapPlanCompare(const void* a, const void* b)
+{
+    const struct mapPlan *pa = a, *pb = b;
+    if (pa->addrspace != pb->addrspace) return pa->addrspace < pb->addrspace ? -1 : 1;
+    if (pa->address != pb->address) return pa->address < pb->address ? -1 : 1;
+    return 0;
+}
+
+int toscaMapPlanExecute(void)
+{
+    size_t i, n = 0;
+    int status = 0;
+
+    pthread_mutex_lock(&mapPlanMutex);
+    /* Merge A32 requests which lie in the same 1 MB blocks or,
+       with toscaMapCoalesce set, which fit into a window of that many MB. */
+    qsort(mapPlan, mapPlanCount, sizeof(struct mapPlan), toscaMapPlanCompare);
+    for (i = 0; i < mapPlanCount; i++)
+    {
+        if (n > 0 && (mapPlan[i].addrspace & VME_A32) && mapPlan[i].addrspace == mapPlan[n-1].addrspace)
+        {
+            struct mapPlan *last = &mapPlan[n-1];
+            uint64_t start = last->address & ~0xfffffLL;
+            uint64_t end = last->address + last->size;
+            uint64_t newend = mapPlan[i].address + mapPlan[i].size;
+            uint64_t maxsize = (uint64_t)toscaMapCoalesce << 20;
+
+            if (newend < end) newend = end;
+            if (((mapPlan[i].address & ~0xfffffLL) <= ((end - 1) | 0xfffffLL)) ||
+                newend - start <= maxsize)
+            {
+                last->size = newend - last->address;
+                continue;
+            }
+        }
+        mapPlan[n++] = mapPlan[i];
+    }
+    debug("%zu requests merged into %zu maps", mapPlanCount, n);
+    for (i = 0; i < n; i++)
+    {
+        debug("%s:0x%"PRIx64"[0x%zx]", toscaAddrSpaceToStr(mapPlan[i].addrspace),
+            mapPlan[i].address, mapPlan[i].size);
+        if (!toscaMap(mapPlan[i].addrspace, mapPlan[i].address, mapPlan[i].size, 0))
+        {
+            debugErrno("toscaMap(%s:0x%"PRIx64", 0x%zx)", toscaAddrSpaceToStr(mapPlan[i].addrspace),
+                mapPlan[i].address, mapPlan[i].size);
+            status = -1;
+        }
+    }
+    free(mapPlan);
+    mapPlan = NULL;
+    mapPlanCount = mapPlanCapacity = 0;
+    pthread_mutex_unlock(&mapPlanMutex);
+    return status;
+}
+
+int toscaMapPrefault(const volatile void* ptr, size_t size)
+{
+    toscaMapInfo_t info = toscaMapFind(ptr);
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    volatile char *p, *end;
+
+    if (!info.addrspace || (info.addrspace & 0xfe0) > VME_SLAVE)
+    {
+        debug("%p is not a Tosca map", ptr);
+        errno = EINVAL;
+        return -1;
+    }
+    if (size == 0 || (volatile char*)ptr + size > (volatile char*)info.baseptr + info.size)
+        size = (volatile char*)info.baseptr + info.size - (volatile char*)ptr;
+    p = (volatile char*)((size_t)ptr & ~(pagesize - 1));
+    end = (volatile char*)ptr + size;
+    /* Let the kernel fill the page tables if it can (Linux 5.14+). */
+    if (madvise((void*)p, end - p, MADV_POPULATE_READ) == 0)
+    {
+        debug("%p size 0x%zx populated", ptr, size);
+        return 0;
+    }
+    /* Not supported by old kernels and by VM_IO/PFNMAP maps.
+       Fall back to reading only where this is harmless: Tosca memory,
+       not registers with read side effects or VME where nobody may answer. */
+    if (!((info.addrspace & TOSCA_SMEM2) == TOSCA_SMEM2 || info.addrspace & (TOSCA_SMEM1|TOSCA_SRAM)))
+    {
+        debugErrno("madvise(MADV_POPULATE_READ) %s map %p",
+            toscaAddrSpaceToStr(info.addrspace), ptr);
+        return -1;
+    }
+    debug("madvise(MADV_POPULATE_READ) failed: %m. Reading each page.");
+    for (; p < end; p += pagesize)
+        (void)*(volatile uint32_t*)p;
+    return 0;
 }
 
 int toscaMapPtrCompare(toscaMapInfo_t info, void* ptr)
@@ -37,6 +37,9 @@ extern int toscaMapDebug;
 /* Set to redirect debug output  */
 extern FILE* toscaMapDebugFile;
 
+/* Find Tosca devices. Runs only once, on first use of any function. */
+void toscaInit();
+
 /* Report found Tosca devices */
 unsigned int toscaDriverVersion();
 unsigned int toscaNumDevices();
@@ -60,6 +63,45 @@ volatile void* toscaMap(unsigned int addrspace, uint64_t address, size_t size, u
    At the moment, Tosca does not support A64 but maybe one day?
 */
 
+int toscaUnmap(volatile void* ptr);
+/* Releases a map obtained from toscaMap(). ptr may be anywhere in the map. */
+/* Maps are shared and reference counted. The last release unmaps and disables the VME window */
+/* (unless toscaMapEvict is set). Maps which are never released stay forever. */
+/* VME_SLAVE maps cannot be released. */
+/* Returns 0 on success or -1 and sets errno on error */
+
+extern int toscaMapEvict;
+/* If set, released maps stay idle for re-use until a new VME master window */
+/* cannot be created. Then the least recently used idle maps are evicted. */
+
+extern int toscaMapCoalesce;
+/* If set to n > 0, new A32 master windows are enlarged to a grid of n MB */
+/* so that later nearby requests re-use them instead of creating new windows. */
+
+extern int toscaMapPopulate;
+/* If set, new maps are created with MAP_POPULATE to avoid page faults at first access. */
+
+extern int toscaMapAlign;
+/* If set to a power of 2 (e.g. 0x200000 or 0x40000000), maps of at least that size */
+/* are placed at addresses aligned to it, so the kernel can use huge page mappings. */
+
+int toscaMapPrefault(const volatile void* ptr, size_t size);
+/* Fills in the page tables of size bytes of an existing map from ptr (0: to end of map). */
+/* Falls back to reading one word of each page of SMEM and SRAM maps if the kernel does not support this. */
+/* Returns 0 on success or -1 and sets errno if ptr is not in a map or the kernel cannot */
+/* populate a map of another address space. */
+
+int toscaMapPlanAdd(unsigned int addrspace, uint64_t address, size_t size);
+int toscaMapPlanExecute(void);
+/* Collect master maps needed later (e.g. at startup) and create them in one batch. */
+/* Requests on A32 are merged into fewer windows (up to toscaMapCoalesce MB). */
+/* Returns 0 on success or -1 and sets errno if any map failed. */
+
+const char* toscaUioDevice(const char* name, size_t* size);
+/* Finds the UIO device (e.g. "uio0") of platform device *.name (e.g. "sram", "pon") */
+/* and the size of its first map. All UIO devices are scanned once on first use. */
+/* Returns NULL and sets errno to ENODEV if not found. */
+
 /* Several map lookup functions. addrspace will be 0 if map is not found. */
 typedef struct {
     uint64_t baseaddress;
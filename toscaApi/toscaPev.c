@@ -8,14 +8,20 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <signal.h>
-#include <sys/select.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <endian.h>
 #include <malloc.h>
 
 #ifndef O_CLOEXEC
 #define O_CLOEXEC 02000000
 #define open(path,flags) ({int _fd=open(path,(flags)&~O_CLOEXEC); if ((flags)&O_CLOEXEC) fcntl(_fd, F_SETFD, fcntl(_fd, F_GETFD)|FD_CLOEXEC); _fd; })
-#define pipe2(fds,flags) ({int _st=pipe(fds); fcntl(fds[0], F_SETFD, fcntl(fds[0], F_GETFD) | FD_CLOEXEC); fcntl(fds[1], F_SETFD, fcntl(fds[1], F_GETFD)|FD_CLOEXEC); _st; })
+#endif
+
+#ifndef EFD_CLOEXEC
+#define EFD_CLOEXEC 02000000
+#define EFD_NONBLOCK 04000
+#define eventfd(I,F) ({int _fd=eventfd(I,0); fcntl(_fd, F_SETFD, fcntl(_fd, F_GETFD) | FD_CLOEXEC); fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK); _fd; })
 #endif
 
 #include "toscaPev.h"
@@ -119,7 +125,7 @@ int pevx_elb_rd(uint crate, int address)
     }
     else
     {
-        return toscaPonRead(address);
+        return toscaPonReadCached(address);
     }
 }
 
@@ -157,7 +163,7 @@ int pev_elb_wr(int address, int value)
 
 int pev_smon_rd(int address)
 {
-    return toscaSmonRead(address);
+    return toscaSmonReadCached(address);
 }
 
 void pev_smon_wr(int address, int value)
@@ -186,33 +192,49 @@ static int pev_bmr_fd(uint bmr)
 #define I2C_CTL_DONE     0x200000
 #define I2C_CTL_ERROR    0x300000
 
-int pev_bmr_read(uint bmr, uint address, uint *pvalue, uint count)
+int pevBmrRead(uint bmr, uint address, uint *pvalue, uint count)
 {
-    int fd, status;
+    int fd;
     uint value;
     debug("bmr=%u address=0x%x, count=%u", bmr, address, count);
     fd = pev_bmr_fd(bmr);
     if (fd < 0) return -1;
-    status = i2cRead(fd, address, count, &value);
-    usleep(1000);
-    if (status != 0) return I2C_CTL_ERROR;
+    if (i2cRead(fd, address, count, &value) != 0) return -1;
 #if __BYTE_ORDER == __BIG_ENDIAN
     value >>= (sizeof(uint) - count) * 8;
 #endif
     *pvalue = value;
-    return I2C_CTL_DONE;
+    return 0;
 }
 
-int pev_bmr_write(uint bmr, uint address, uint value, uint count)
+int pevBmrWrite(uint bmr, uint address, uint value, uint count)
 {
-    int fd, status;
+    int fd;
     debug("bmr=%u address=0x%x, value=0x%x  count=%u", bmr, address, value, count);
     fd = pev_bmr_fd(bmr);
     if (fd < 0) return -1;
 #if __BYTE_ORDER == __BIG_ENDIAN
     value <<= (sizeof(int) - count) * 8;
 #endif
-    status = i2cWrite(fd, address, count, value);
+    if (i2cWrite(fd, address, count, value) != 0) return -1;
+    return 0;
+}
+
+int pev_bmr_read(uint bmr, uint address, uint *pvalue, uint count)
+{
+    int status;
+    if (pev_bmr_fd(bmr) < 0) return -1;
+    status = pevBmrRead(bmr, address, pvalue, count);
+    usleep(1000);
+    if (status != 0) return I2C_CTL_ERROR;
+    return I2C_CTL_DONE;
+}
+
+int pev_bmr_write(uint bmr, uint address, uint value, uint count)
+{
+    int status;
+    if (pev_bmr_fd(bmr) < 0) return -1;
+    status = pevBmrWrite(bmr, address, value, count);
     usleep(1000);
     if (status != 0) return I2C_CTL_ERROR;
     return I2C_CTL_DONE;
@@ -369,20 +391,45 @@ int pev_map_modify(struct pev_ioctl_map_pg *map_p)
 
 /** INTR **************************************************/
 
+/* The event queue is a single producer (interrupt handler thread)
+   single consumer (caller of pev_evt_read) ring buffer.
+   The eventfd doorbell is only rung when the consumer sleeps.
+*/
+
+#define PEV_EVT_QUEUE_SIZE 4096 /* must be power of 2 */
+
 typedef struct {
-    int fd[2];
+    int fd;
     int enabled;
     intrmask_t mask;
+    volatile unsigned int head;   /* written by producer only */
+    volatile unsigned int tail;   /* written by consumer only */
+    volatile int sleeping;        /* written by consumer only */
+    unsigned long lost;
+    uint16_t queue[PEV_EVT_QUEUE_SIZE];
 } my_pev_evt_queue;
 
 struct pev_ioctl_evt *pevx_evt_queue_alloc(uint crate, int sig)
 {
     struct pev_ioctl_evt *evt;
+    my_pev_evt_queue *q;
+
     if (crate > 0) return NULL;
     evt = calloc(1, sizeof(struct pev_ioctl_evt) + sizeof(my_pev_evt_queue));
+    if (!evt)
+    {
+        debugErrno("calloc");
+        return NULL;
+    }
     evt->sig = sig;
-    evt->evt_queue = evt + 1;
-    pipe2(((my_pev_evt_queue*)evt->evt_queue)->fd, O_NONBLOCK|O_CLOEXEC);
+    evt->evt_queue = q = (my_pev_evt_queue*)(evt + 1);
+    q->fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (q->fd < 0)
+    {
+        debugErrno("eventfd");
+        free(evt);
+        return NULL;
+    }
     return evt;
 }
 
@@ -391,6 +438,65 @@ struct pev_ioctl_evt *pev_evt_queue_alloc(int sig)
     return pevx_evt_queue_alloc(defaultCrate, sig);
 }
 
+static void pev_evt_put(struct pev_ioctl_evt *evt, uint16_t ev)
+{
+    static const uint64_t one = 1;
+    my_pev_evt_queue *q = (my_pev_evt_queue*)evt->evt_queue;
+    unsigned int head = q->head;
+
+    if (head - q->tail >= PEV_EVT_QUEUE_SIZE)
+    {
+        q->lost++;
+        debug("queue full, ev=0x%04x lost (%lu total)", ev, q->lost);
+    }
+    else
+    {
+        q->queue[head & (PEV_EVT_QUEUE_SIZE-1)] = ev;
+        __sync_synchronize();
+        q->head = head + 1;
+        /* order head before sleeping, pairs with pev_evt_wait */
+        __sync_synchronize();
+        if (q->sleeping && write(q->fd, &one, sizeof(one)) < 0)
+            debugErrno("write eventfd %d", q->fd);
+    }
+    if (evt->sig) kill(getpid(), evt->sig);
+}
+
+static int pev_evt_wait(my_pev_evt_queue *q, int timeout)
+{
+    struct pollfd pfd;
+    uint64_t n;
+    int status = 0;
+
+    pfd.fd = q->fd;
+    pfd.events = POLLIN;
+    q->sleeping = 1;
+    /* order sleeping before head, pairs with pev_evt_put */
+    __sync_synchronize();
+    while (q->head == q->tail)
+    {
+        switch (poll(&pfd, 1, timeout < 0 ? -1 : timeout))
+        {
+            case 1:
+                if (read(q->fd, &n, sizeof(n)) < 0 && errno != EAGAIN)
+                    debugErrno("read eventfd %d", q->fd);
+                continue;
+            case 0:
+                errno = ETIMEDOUT;
+                status = -1;
+                break;
+            default:
+                /* our own signal may interrupt us, then the event is already queued */
+                if (errno == EINTR) continue;
+                debugErrno("poll eventfd %d", q->fd);
+                status = -1;
+        }
+        break;
+    }
+    q->sleeping = 0;
+    return status;
+}
+
 static void pev_intr_vme(struct pev_ioctl_evt *evt, int inum, int vec)
 {
     my_pev_evt_queue *q = (my_pev_evt_queue*)evt->evt_queue;
@@ -398,8 +504,7 @@ static void pev_intr_vme(struct pev_ioctl_evt *evt, int inum, int vec)
     if (!q->enabled) return;
     uint16_t ev = (EVT_SRC_VME | inum) << 8 | vec;
     debug("ev=0x%04x sig=%i", ev, evt->sig);
-    write(q->fd[1], &ev, 2);
-    if (evt->sig) kill(getpid(), evt->sig);
+    pev_evt_put(evt, ev);
 }
 
 static void pev_intr_usr(struct pev_ioctl_evt *evt, int inum)
@@ -409,8 +514,7 @@ static void pev_intr_usr(struct pev_ioctl_evt *evt, int inum)
     if (!q->enabled) return;
     uint16_t ev = (EVT_SRC_USR1 | inum) << 8;
     debug("ev=0x%04x sig=%i", ev, evt->sig);
-    write(q->fd[1], &ev, 2);
-    if (evt->sig) kill(getpid(), evt->sig);
+    pev_evt_put(evt, ev);
 }
 
 int pevx_evt_register(uint crate, struct pev_ioctl_evt *evt, int src_id)
@@ -452,8 +556,8 @@ int pevx_evt_queue_free(uint crate __attribute__((unused)), struct pev_ioctl_evt
     q->enabled = 0;
     toscaIntrDisconnectHandler(TOSCA_VME_INTR_ANY, pev_intr_vme, evt);
     toscaIntrDisconnectHandler(TOSCA_USER_INTR_ANY, pev_intr_usr, evt);
-    close(q->fd[0]);
-    close(q->fd[1]);
+    toscaIntrDispatchWait(); /* a handler may still be writing into the ring */
+    close(q->fd);
     free(evt);
     return 0;
 }
@@ -465,40 +569,60 @@ int pev_evt_queue_free(struct pev_ioctl_evt *evt)
 
 int pevx_evt_read(uint crate __attribute__((unused)), struct pev_ioctl_evt *evt, int timeout)
 {
-    int fd = ((my_pev_evt_queue*)evt->evt_queue)->fd[0];
+    my_pev_evt_queue *q = (my_pev_evt_queue*)evt->evt_queue;
+    unsigned int tail = q->tail;
     uint16_t ev;
 
-    if (timeout)
+    if (q->head == tail)
     {
-        fd_set read_fs;
-        struct timeval tv;
-        int n;
-
-        FD_ZERO(&read_fs);
-        FD_SET(fd, &read_fs);
-        if (timeout > 0)
-        {
-            tv.tv_sec = timeout/1000;
-            tv.tv_usec = (timeout%1000)*1000;
-        }
-        n = select(fd + 1, &read_fs, NULL, NULL, timeout > 0 ? &tv : NULL);
-        if (n < 1)
+        if (timeout == 0) return 0;
+        if (pev_evt_wait(q, timeout) != 0)
         {
-            debugErrno("crate=%d select", crate);
+            debugErrno("crate=%d wait", crate);
             return -1 << 8;
         }
     }
-    if (read(fd, &ev, 2) < 0) /* non-blocking */
-    {
-        if (errno == EWOULDBLOCK)
-            return 0;
-        else
-            return -1 << 8;
-    }
+    __sync_synchronize();
+    ev = q->queue[tail & (PEV_EVT_QUEUE_SIZE-1)];
+    __sync_synchronize();
+    q->tail = tail + 1;
     debug("crate=%d ev=0x%04x", crate, ev);
     return ev;
 }
 
+int pevEvtReadBatch(unsigned int card, struct pev_ioctl_evt *evt, uint16_t *events, size_t count, int timeout)
+{
+    my_pev_evt_queue *q = (my_pev_evt_queue*)evt->evt_queue;
+    unsigned int tail = q->tail;
+    size_t i, n;
+
+    if (card != 0)
+    {
+        debug("can only access crate 0");
+        return -1;
+    }
+    if (count == 0) return 0;
+    if (q->head == tail)
+    {
+        if (timeout == 0) return 0;
+        if (pev_evt_wait(q, timeout) != 0)
+        {
+            if (errno == ETIMEDOUT) return 0;
+            debugErrno("card=%u wait", card);
+            return -1;
+        }
+    }
+    __sync_synchronize();
+    n = q->head - tail;
+    if (n > count) n = count;
+    for (i = 0; i < n; i++)
+        events[i] = q->queue[(tail + i) & (PEV_EVT_QUEUE_SIZE-1)];
+    __sync_synchronize();
+    q->tail = tail + n;
+    debug("card=%u %zu events", card, n);
+    return n;
+}
+
 int pev_evt_read(struct pev_ioctl_evt *evt, int timeout)
 {
     return pevx_evt_read(defaultCrate, evt, timeout);
@@ -760,14 +884,12 @@ int pevIntrDisable(unsigned int card, unsigned int src_id)
 
 void* pevDmaAlloc(unsigned int card __attribute__((unused)), size_t size)
 {
-    void* newptr = NULL;
-    posix_memalign(&newptr, sysconf(_SC_PAGESIZE), size);
-    return newptr;
+    return toscaDmaAlloc(size);
 }
 
 void* pevDmaFree(unsigned int card __attribute__((unused)), void* oldptr)
 {
-    free(oldptr);
+    toscaDmaFree(oldptr);
     return NULL;
 }
 
@@ -2,6 +2,7 @@
 #define toscaPev_h
 
 #include <stddef.h>
+#include <stdint.h>
 #include <pevioctl.h>
 #include <pevulib.h>
 #include <pevxulib.h>
@@ -27,6 +28,11 @@ int pevIntrConnect(unsigned int card, unsigned int src_id, unsigned int vec_id,
 
 int pevIntrDisconnect(unsigned int card, unsigned int src_id, unsigned int vec_id, void (*func)(), void* usr);
 
+int pevEvtReadBatch(unsigned int card, struct pev_ioctl_evt *evt, uint16_t *events, size_t count, int timeout);
+/* Reads up to count queued events like pev_evt_read into the events array. */
+/* Waits up to timeout ms (forever if negative) only if the queue is empty. */
+/* Returns number of events read (0 on timeout) or -1 on error. */
+
 int pevIntrEnable(unsigned int card, unsigned int src_id);
 
 int pevIntrDisable(unsigned int card, unsigned int src_id);
@@ -61,6 +67,13 @@ int pevDmaTransfer(unsigned int card, unsigned int src_space, size_t src_addr, u
     pevDmaTransfer((card), (src_space), (src_addr), DMA_SPACE_BUF, (size_t)(void*)(buffer), (size), (dont_use), 0, NULL, NULL)
 
 
+int pevBmrRead(unsigned int bmr, unsigned int address, unsigned int *pvalue, unsigned int count);
+int pevBmrWrite(unsigned int bmr, unsigned int address, unsigned int value, unsigned int count);
+/* Like pev_bmr_read and pev_bmr_write but without the 1 ms delay after the access. */
+/* The caller must pace accesses to the same BMR. */
+/* Return 0 on success or -1 with errno set on error. */
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,21 +1,34 @@
 #include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #include <endian.h>
 #ifndef le32toh
+#include <byteswap.h>
 #if  __BYTE_ORDER == __LITTLE_ENDIAN
 #define le32toh(x) (x)
 #define htole32(x) (x)
+#define be32toh(x) __bswap_32(x)
+#define htobe32(x) __bswap_32(x)
 #else
-#include <byteswap.h>
 #define le32toh(x) __bswap_32(x)
 #define htole32(x) __bswap_32(x)
+#define be32toh(x) (x)
+#define htobe32(x) (x)
 #endif
 #endif
 
 #include "sysfs.h"
 #include "toscaMap.h"
 #include "toscaReg.h"
+#include "toscaIntr.h"
 
 #define TOSCA_DEBUG_NAME toscaReg
 #include "toscaDebug.h"
@@ -130,8 +143,11 @@ unsigned int toscaSmonRead(unsigned int address)
     return value;
 }
 
+static void toscaSmonSnapshotUpdate(unsigned int address, unsigned int value);
+
 unsigned int toscaSmonWriteMasked(unsigned int address, unsigned int mask, unsigned int value)
 {
+    unsigned int device = address >> 16;
     errno = 0;
     volatile uint32_t* ptr = toscaMap((address & 0xffff0000)|TOSCA_CSR, CSR_SMON_REG, 12, 0);
     debug("address=0x%02x mask=0x%x value=0x%x ptr=%p", address, mask, value, ptr);
@@ -151,6 +167,7 @@ unsigned int toscaSmonWriteMasked(unsigned int address, unsigned int mask, unsig
     ptr[1] = htole32(value);
     value = le32toh(ptr[1]); /* read back to flush write */
     pthread_mutex_unlock(&smon_mutex);
+    toscaSmonSnapshotUpdate((address & 0xffff) | (device << 16), value);
     return value;
 }
 
@@ -169,16 +186,447 @@ unsigned int toscaSmonClear(unsigned int address, unsigned int bitsToClear)
     return toscaSmonWriteMasked(address, bitsToClear, 0);
 }
 
+/* Background sampling of all SMON registers.
+   The sampler thread and toscaSmonWriteMasked update the snapshot with
+   the sampler lock held. They make the sequence number odd while updating,
+   readers retry until they got a copy with the same even sequence number
+   before and after. Registers written during a sampling round are marked
+   so that the sampler does not overwrite them with older values. */
+
+#define SMON_NUM_REGS 0x80
+#define SMON_MAX_DEVICES 16
+
+struct smonCallback {
+    void (*callback)(void* usr);
+    void* usr;
+    struct smonCallback* next;
+};
+
+struct smonSampler {
+    volatile unsigned int seq;
+    uint32_t regs[SMON_NUM_REGS];
+    char written[SMON_NUM_REGS];
+    pthread_mutex_t lock;
+    unsigned int device;
+    struct timespec period;
+    struct smonCallback* volatile callbacks; /* append only */
+    unsigned long long updates;
+    pthread_t tid;
+};
+
+static struct smonSampler* smonSamplers[SMON_MAX_DEVICES];
+static pthread_mutex_t smonSamplerMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void toscaSmonSnapshotUpdate(unsigned int address, unsigned int value)
+{
+    struct smonSampler* sampler;
+    unsigned int device = address >> 16;
+
+    address &= 0xffff;
+    if (device >= SMON_MAX_DEVICES || address >= SMON_NUM_REGS || !(sampler = smonSamplers[device]))
+        return;
+    pthread_mutex_lock(&sampler->lock);
+    sampler->seq++;
+    __sync_synchronize();
+    sampler->regs[address] = value;
+    sampler->written[address] = 1;
+    __sync_synchronize();
+    sampler->seq++;
+    pthread_mutex_unlock(&sampler->lock);
+}
+
+static void* toscaSmonSampler(void* arg)
+{
+    struct smonSampler* sampler = arg;
+    struct smonCallback* cb;
+    uint32_t regs[SMON_NUM_REGS];
+    unsigned int address;
+
+    debug("SMON sampler device %u started", sampler->device);
+    while (1)
+    {
+        pthread_mutex_lock(&sampler->lock);
+        memset(sampler->written, 0, sizeof(sampler->written));
+        pthread_mutex_unlock(&sampler->lock);
+        for (address = 0; address < SMON_NUM_REGS; address++)
+            regs[address] = toscaSmonRead(sampler->device << 16 | address);
+        pthread_mutex_lock(&sampler->lock);
+        sampler->seq++;
+        __sync_synchronize();
+        for (address = 0; address < SMON_NUM_REGS; address++)
+            if (!sampler->written[address]) /* else written meanwhile: keep newer value */
+                sampler->regs[address] = regs[address];
+        __sync_synchronize();
+        sampler->seq++;
+        pthread_mutex_unlock(&sampler->lock);
+        sampler->updates++;
+        __sync_synchronize();
+        for (cb = sampler->callbacks; cb; cb = cb->next)
+            cb->callback(cb->usr);
+        nanosleep(&sampler->period, NULL);
+    }
+    return NULL;
+}
+
+int toscaSmonSamplerStart(unsigned int device, double period, void (*callback)(void* usr), void* usr)
+{
+    struct smonSampler* sampler;
+    struct smonCallback* cb = NULL;
+    int status;
+
+    if (device >= SMON_MAX_DEVICES || period <= 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&smonSamplerMutex);
+    if (callback)
+    {
+        cb = calloc(1, sizeof(struct smonCallback));
+        if (!cb)
+        {
+            pthread_mutex_unlock(&smonSamplerMutex);
+            return -1;
+        }
+        cb->callback = callback;
+        cb->usr = usr;
+    }
+    sampler = smonSamplers[device];
+    if (sampler)
+    {
+        /* already running: append callback */
+        if (cb)
+        {
+            struct smonCallback** pcb;
+            for (pcb = (struct smonCallback**)&sampler->callbacks; *pcb; pcb = &(*pcb)->next);
+            __sync_synchronize();
+            *pcb = cb;
+        }
+        pthread_mutex_unlock(&smonSamplerMutex);
+        return 0;
+    }
+    sampler = calloc(1, sizeof(struct smonSampler));
+    if (!sampler)
+    {
+        pthread_mutex_unlock(&smonSamplerMutex);
+        free(cb);
+        return -1;
+    }
+    pthread_mutex_init(&sampler->lock, NULL);
+    sampler->device = device;
+    sampler->period.tv_sec = (time_t)period;
+    sampler->period.tv_nsec = (long)((period - sampler->period.tv_sec) * 1e9);
+    sampler->callbacks = cb;
+    /* first snapshot before anyone reads */
+    for (status = 0; status < SMON_NUM_REGS; status++)
+        sampler->regs[status] = toscaSmonRead(device << 16 | status);
+    status = pthread_create(&sampler->tid, NULL, toscaSmonSampler, sampler);
+    if (status != 0)
+    {
+        pthread_mutex_unlock(&smonSamplerMutex);
+        free(cb);
+        free(sampler);
+        errno = status;
+        return -1;
+    }
+    pthread_detach(sampler->tid);
+    smonSamplers[device] = sampler;
+    pthread_mutex_unlock(&smonSamplerMutex);
+    return 0;
+}
+
+int toscaSmonSnapshot(unsigned int address, unsigned int nregs, unsigned int* values)
+{
+    struct smonSampler* sampler;
+    unsigned int device = address >> 16;
+    unsigned int seq, i;
+
+    address &= 0xffff;
+    if (device >= SMON_MAX_DEVICES || !(sampler = smonSamplers[device]))
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    if (address >= SMON_NUM_REGS || nregs > SMON_NUM_REGS - address)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    do {
+        while ((seq = sampler->seq) & 1);
+        __sync_synchronize();
+        for (i = 0; i < nregs; i++)
+            values[i] = sampler->regs[address + i];
+        __sync_synchronize();
+    } while (seq != sampler->seq);
+    return 0;
+}
+
+unsigned int toscaSmonReadCached(unsigned int address)
+{
+    unsigned int value;
+
+    errno = 0;
+    if (toscaSmonSnapshot(address, 1, &value) == 0)
+        return value;
+    if (errno != ENOENT)
+        return (unsigned int)-1;
+    return toscaSmonRead(address);
+}
+
+unsigned long long toscaSmonSamplerUpdates(unsigned int device)
+{
+    if (device >= SMON_MAX_DEVICES || !smonSamplers[device]) return 0;
+    return smonSamplers[device]->updates;
+}
+
 
 /* Read (and clear) VME error status. Error is latched and not overwritten until read. */
 
 #define CSR_VMEERR_REG 0x418
 
+/* Every error read from the latch is appended to a ring of events.
+   The writer holds vmeErrLock (so that reading the latch and recording
+   the event is atomic for toscaVmeErrSince), readers do not lock:
+   each slot has the sequence number of its event, 0 while being written.
+   Readers keep their own cursors and detect overwritten slots. */
+
+static pthread_mutex_t vmeErrLock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    volatile uint64_t seq;
+    toscaVmeErrEvent event;
+} vmeErrRing[TOSCA_VME_ERR_RING_SIZE];
+static volatile uint64_t vmeErrHead;
+
 toscaMapVmeErr_t toscaGetVmeErr(unsigned int device)
 {
+    toscaMapVmeErr_t err;
     volatile uint32_t* vmeerr = toscaMap((device<<16)|TOSCA_CSR, CSR_VMEERR_REG, 8, 0);
     if (!vmeerr) return (toscaMapVmeErr_t) { .address = -1 };
-    return (toscaMapVmeErr_t) { .address = le32toh(vmeerr[0]), {.status = le32toh(vmeerr[1])} };
+    pthread_mutex_lock(&vmeErrLock);
+    err = (toscaMapVmeErr_t) { .address = le32toh(vmeerr[0]), {.status = le32toh(vmeerr[1])} };
+    if (err.err)
+    {
+        uint64_t seq = vmeErrHead + 1;
+        unsigned int slot = seq % TOSCA_VME_ERR_RING_SIZE;
+
+        vmeErrRing[slot].seq = 0;
+        __sync_synchronize();
+        clock_gettime(CLOCK_REALTIME, &vmeErrRing[slot].event.time);
+        vmeErrRing[slot].event.seq = seq;
+        vmeErrRing[slot].event.device = device;
+        vmeErrRing[slot].event.err = err;
+        __sync_synchronize();
+        vmeErrRing[slot].seq = seq;
+        __sync_synchronize(); /* slot before head */
+        vmeErrHead = seq;
+    }
+    pthread_mutex_unlock(&vmeErrLock);
+    return err;
+}
+
+uint64_t toscaVmeErrCursor(void)
+{
+    return vmeErrHead;
+}
+
+size_t toscaVmeErrRead(uint64_t* cursor, toscaVmeErrEvent* events, size_t n)
+{
+    size_t count = 0;
+    uint64_t seq, head;
+
+    while (count < n && (seq = *cursor + 1) <= (head = vmeErrHead))
+    {
+        unsigned int slot = seq % TOSCA_VME_ERR_RING_SIZE;
+
+        __sync_synchronize(); /* head before slot */
+        if (head - *cursor > TOSCA_VME_ERR_RING_SIZE)
+        {
+            /* overrun: skip to oldest event still available */
+            *cursor = head - TOSCA_VME_ERR_RING_SIZE;
+            continue;
+        }
+        if (vmeErrRing[slot].seq != seq)
+        {
+            if (vmeErrRing[slot].seq == 0) continue; /* being written, retry */
+            *cursor = seq; /* overwritten */
+            continue;
+        }
+        __sync_synchronize();
+        events[count] = vmeErrRing[slot].event;
+        __sync_synchronize();
+        if (vmeErrRing[slot].seq != seq)
+            continue; /* overwritten while copying, next round skips it */
+        *cursor = seq;
+        count++;
+    }
+    return count;
+}
+
+static void toscaVmeErrHandler(void* parameter __attribute__((unused)), int inum, int ivec __attribute__((unused)))
+{
+    debugLvl(2, "VME error interrupt inum=%d", inum);
+    toscaGetVmeErr(0);
+}
+
+int toscaVmeErrMonitorStart(void)
+{
+    static int running = 0;
+
+    if (__sync_lock_test_and_set(&running, 1)) return 0;
+    if (toscaIntrConnectHandler(TOSCA_VME_ERROR, toscaVmeErrHandler, NULL) != 0)
+    {
+        debugErrno("toscaIntrConnectHandler VME-ERROR");
+        running = 0;
+        return -1;
+    }
+    /* Record anything that happened before */
+    toscaGetVmeErr(0);
+    return 0;
+}
+
+int toscaVmeErrMatches(toscaMapVmeErr_t err, unsigned int addrspace, uint64_t address, int isWrite)
+{
+    if (!err.err) return 0;
+    if (err.source != 0) return 0; /* Not from PCIe, thus not from a CPU access. */
+    if (err.write != (isWrite != 0)) return 0;
+    switch (err.mode)
+    {
+        case 0: /* CRCSR */
+            return (addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_CRCSR &&
+                ((err.address ^ address) & 0xfffffc) == 0;
+        case 1: /* A16 */
+            return (addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_A16 &&
+                ((err.address ^ address) & 0xfffc) == 0;
+        case 2: /* A24 */
+            return (addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_A24 &&
+                ((err.address ^ address) & 0xfffffc) == 0;
+        case 3: /* A32 */
+            return (addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_A32 &&
+                ((err.address ^ address) & 0xfffffffc) == 0;
+    }
+    return 0;
+}
+
+/* Probing: The error latch keeps the first error until read.
+   Access all candidates of a range, then check the latch once.
+   An error on one of our candidates means all candidates before it
+   are present. An error of another bus master hides which of our
+   accesses failed: bisect the range (and finally retry single accesses). */
+
+#define PROBE_RETRIES 1000
+
+static pthread_mutex_t probe_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int toscaProbeAccess(toscaProbeCandidate* c)
+{
+    volatile void* ptr = toscaMap(c->addrspace, c->address, c->width, 0);
+    if (!ptr) return -1;
+    switch (c->width)
+    {
+        case 1:
+            if (c->write) *(volatile uint8_t*)ptr = c->value;
+            else c->value = *(volatile uint8_t*)ptr;
+            break;
+        case 2:
+            if (c->write) *(volatile uint16_t*)ptr = c->value;
+            else c->value = *(volatile uint16_t*)ptr;
+            break;
+        case 4:
+            if (c->write) *(volatile uint32_t*)ptr = c->value;
+            else c->value = *(volatile uint32_t*)ptr;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+    return 0;
+}
+
+/* Errors may have been read by the VME error monitor already: use the event ring. */
+static toscaMapVmeErr_t toscaProbeError(unsigned int device, uint64_t cursor)
+{
+    toscaVmeErrEvent event;
+
+    toscaGetVmeErr(device);
+    while (toscaVmeErrRead(&cursor, &event, 1))
+        if (event.device == device) return event.err;
+    return (toscaMapVmeErr_t) { .address = 0 };
+}
+
+#define PRESENT(i) present[(i)/(8*sizeof(unsigned long))] |= 1UL << ((i)%(8*sizeof(unsigned long)))
+
+static int toscaProbeRange(unsigned int device, toscaProbeCandidate* cand, size_t lo, size_t hi, unsigned long* present)
+{
+    toscaMapVmeErr_t err;
+    size_t i;
+    int retries = PROBE_RETRIES;
+
+    while (lo < hi)
+    {
+        uint64_t cursor = toscaVmeErrCursor();
+        for (i = lo; i < hi; i++)
+            if (toscaProbeAccess(&cand[i]) != 0) return -1;
+        err = toscaProbeError(device, cursor);
+        if (!err.err)
+        {
+            for (i = lo; i < hi; i++) PRESENT(i);
+            return 0;
+        }
+        for (i = lo; i < hi; i++)
+            if (toscaVmeErrMatches(err, cand[i].addrspace, cand[i].address, cand[i].write)) break;
+        if (i < hi)
+        {
+            debugLvl(2, "no response at %s:0x%"PRIx64, toscaAddrSpaceToStr(cand[i].addrspace), cand[i].address);
+            for (; lo < i; lo++) PRESENT(lo);
+            lo = i + 1;
+            continue;
+        }
+        debugLvl(2, "foreign VME error at 0x%"PRIx64" mode %d source %d", err.address, err.mode, err.source);
+        if (hi - lo > 1)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (toscaProbeRange(device, cand, lo, mid, present) != 0) return -1;
+            lo = mid;
+            continue;
+        }
+        if (--retries == 0)
+        {
+            /* All errors have been on other addresses. */
+            PRESENT(lo);
+            return 0;
+        }
+    }
+    return 0;
+}
+
+int toscaProbeBatch(toscaProbeCandidate* cand, size_t n, unsigned long* present)
+{
+    unsigned int device;
+    size_t i;
+    int status, count = 0;
+
+    if (n == 0) return 0;
+    device = cand[0].addrspace >> 16;
+    for (i = 0; i < n; i++)
+    {
+        if (cand[i].addrspace >> 16 != device || !(cand[i].addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)))
+        {
+            debug("candidate %zu: %s not a VME address space of device %u",
+                i, toscaAddrSpaceToStr(cand[i].addrspace), device);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    memset(present, 0, (n + 8*sizeof(unsigned long) - 1) / (8*sizeof(unsigned long)) * sizeof(unsigned long));
+    pthread_mutex_lock(&probe_mutex);
+    toscaGetVmeErr(device); /* clear latch */
+    status = toscaProbeRange(device, cand, 0, n, present);
+    pthread_mutex_unlock(&probe_mutex);
+    if (status != 0) return -1;
+    for (i = 0; i < n; i++)
+        if (present[i/(8*sizeof(unsigned long))] & (1UL << (i%(8*sizeof(unsigned long))))) count++;
+    return count;
 }
 
 
@@ -203,54 +651,324 @@ const char* toscaPonAddrToRegname(unsigned int address)
     }
 };
 
+/* PON registers 0x00-0x24 and 0x40 */
+#define PON_NUM_REGS 11
+#define PON_CFGDATA 9 /* reading may have side effects: not sampled */
+
+static int toscaPonIndex(unsigned int address)
+{
+    address &= ~3;
+    if (address == 0x40) return 10;
+    if (address >= 0x28) return -1;
+    return address >> 2;
+}
+
+static unsigned int toscaPonIndexToAddr(int index)
+{
+    return index == 10 ? 0x40 : index << 2;
+}
+
+/* If the kernel provides a UIO device for PON, access the registers directly.
+   Else use the sysfs files of the pon driver. */
+static volatile uint32_t* ponRegs;
+static pthread_once_t ponMapOnce = PTHREAD_ONCE_INIT;
+
+static void toscaPonMap(void)
+{
+    char filename[40];
+    const char* uiodev;
+    void* ptr;
+    int fd;
+
+    uiodev = toscaUioDevice("pon", NULL);
+    if (!uiodev)
+    {
+        debug("no PON UIO device, using sysfs");
+        return;
+    }
+    snprintf(filename, sizeof(filename), "/dev/%s", uiodev);
+    fd = open(filename, O_RDWR|O_CLOEXEC);
+    if (fd < 0)
+    {
+        debugErrno("open %s", filename);
+        return;
+    }
+    ptr = mmap(NULL, 0x1000, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+    {
+        debugErrno("mmap %s", filename);
+        return;
+    }
+    debug("PON registers mapped from %s", filename);
+    ponRegs = ptr;
+}
+
 int toscaPonFd(unsigned int address)
 {
-    static int fd[11] = {0};
-    unsigned int reg;
+    static int fd[PON_NUM_REGS] = {0};
+    int reg = toscaPonIndex(address);
 
-    address &= ~3;
-    if (address >= 0x28 && address != 0x40)
+    if (reg < 0)
     {
         debug("address=0x%x -- not implemented", address);
         errno = EINVAL;
         return -1;
     }
-    if (address == 40) reg = 10;
-    else reg = address>>2;
     if (!fd[reg])
     {
         char filename[50];
-        sprintf(filename, "/sys/devices/{,*/}*localbus/*.pon/%s", toscaPonAddrToRegname(address));
+        sprintf(filename, "/sys/devices/{,*/}*localbus/*.pon/%s", toscaPonAddrToRegname(address & ~3));
         fd[reg] = sysfsOpen(filename);
     }
-    debug("address=0x%02x regname=%s fd=%d", address, toscaPonAddrToRegname(address), fd[reg]);
+    debug("address=0x%02x regname=%s fd=%d", address, toscaPonAddrToRegname(address & ~3), fd[reg]);
     return fd[reg];
 }
 
-unsigned int toscaPonRead(unsigned int address)
+static unsigned int toscaPonReadHw(unsigned int address)
 {
-    debug("address=0x%02x", address);
-    int fd = toscaPonFd(address);
+    char buffer[24];
+    ssize_t n;
+    int fd;
+
+    errno = 0;
+    pthread_once(&ponMapOnce, toscaPonMap);
+    if (ponRegs)
+    {
+        if (toscaPonIndex(address) < 0) { errno = EINVAL; return (unsigned int)-1; }
+        return be32toh(ponRegs[(address & ~3) >> 2]);
+    }
+    fd = toscaPonFd(address);
     if (fd < 0) return (unsigned int)-1;
-    return sysfsReadULong(fd);
+    n = pread(fd, buffer, sizeof(buffer)-1, 0);
+    if (n < 0)
+    {
+        debugErrno("pread %s", toscaPonAddrToRegname(address & ~3));
+        return (unsigned int)-1;
+    }
+    buffer[n] = 0;
+    return strtoul(buffer, NULL, 16);
 }
 
-unsigned int toscaPonWrite(unsigned int address, unsigned int value)
+static int toscaPonWriteHw(unsigned int address, unsigned int value)
 {
-    debug("address=0x%02x value=0x%x", address, value);
-    int fd = toscaPonFd(address);
-    if (fd < 0) return (unsigned int)-1;
-    sysfsWrite(fd, "%x", value);
-    return sysfsReadULong(fd);
+    char buffer[12];
+    int fd, n;
+
+    errno = 0;
+    pthread_once(&ponMapOnce, toscaPonMap);
+    if (ponRegs)
+    {
+        if (toscaPonIndex(address) < 0) { errno = EINVAL; return -1; }
+        ponRegs[(address & ~3) >> 2] = htobe32(value);
+        return 0;
+    }
+    fd = toscaPonFd(address);
+    if (fd < 0) return -1;
+    n = sprintf(buffer, "%x", value);
+    if (pwrite(fd, buffer, n, 0) != n)
+    {
+        debugErrno("pwrite %s", toscaPonAddrToRegname(address & ~3));
+        return -1;
+    }
+    return 0;
+}
+
+/* Cache of all PON registers, updated by a sampler thread and on writes.
+   Writers serialize with ponCache.lock, readers use the sequence number. */
+static struct {
+    volatile unsigned int seq;
+    uint32_t regs[PON_NUM_REGS];
+    pthread_mutex_t lock;
+    struct timespec period;
+    void (*callback)(void* usr, unsigned int changed);
+    void* usr;
+    unsigned long long updates;
+    int running;
+} ponCache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void toscaPonCacheUpdate(int index, unsigned int value)
+{
+    ponCache.seq++;
+    __sync_synchronize();
+    ponCache.regs[index] = value;
+    __sync_synchronize();
+    ponCache.seq++;
+}
+
+int toscaPonReadAll(unsigned int* values)
+{
+    int i;
+
+    for (i = 0; i < PON_NUM_REGS; i++)
+    {
+        if (i == PON_CFGDATA) { values[i] = 0; continue; }
+        values[i] = toscaPonReadHw(toscaPonIndexToAddr(i));
+        if (errno) return -1;
+    }
+    return 0;
+}
+
+static void* toscaPonSampler(void* arg __attribute__((unused)))
+{
+    unsigned int values[PON_NUM_REGS];
+    unsigned int changed;
+    int i;
+
+    while (1)
+    {
+        nanosleep(&ponCache.period, NULL);
+        /* hold the lock to avoid overwriting values of concurrent writes with older samples */
+        pthread_mutex_lock(&ponCache.lock);
+        if (toscaPonReadAll(values) != 0)
+        {
+            pthread_mutex_unlock(&ponCache.lock);
+            debugErrno("toscaPonReadAll");
+            continue;
+        }
+        changed = 0;
+        for (i = 0; i < PON_NUM_REGS; i++)
+        {
+            if (ponCache.regs[i] == values[i]) continue;
+            changed |= 1 << i;
+            toscaPonCacheUpdate(i, values[i]);
+        }
+        ponCache.updates++;
+        pthread_mutex_unlock(&ponCache.lock);
+        if (changed && ponCache.callback)
+            ponCache.callback(ponCache.usr, changed);
+    }
+    return NULL;
+}
+
+int toscaPonSamplerStart(double period, void (*callback)(void* usr, unsigned int changed), void* usr)
+{
+    pthread_t tid;
+    int status;
+
+    if (period <= 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&ponCache.lock);
+    if (ponCache.running)
+    {
+        status = 0;
+        if (callback)
+        {
+            if (ponCache.callback)
+            {
+                error("PON sampler already has a callback");
+                errno = EBUSY;
+                status = -1;
+            }
+            else
+            {
+                ponCache.usr = usr;
+                __sync_synchronize();
+                ponCache.callback = callback;
+            }
+        }
+        pthread_mutex_unlock(&ponCache.lock);
+        return status;
+    }
+    if (toscaPonReadAll(ponCache.regs) != 0)
+    {
+        pthread_mutex_unlock(&ponCache.lock);
+        return -1;
+    }
+    ponCache.period.tv_sec = (time_t)period;
+    ponCache.period.tv_nsec = (long)((period - ponCache.period.tv_sec) * 1e9);
+    ponCache.usr = usr;
+    ponCache.callback = callback;
+    status = pthread_create(&tid, NULL, toscaPonSampler, NULL);
+    if (status != 0)
+    {
+        pthread_mutex_unlock(&ponCache.lock);
+        errno = status;
+        return -1;
+    }
+    pthread_detach(tid);
+    ponCache.running = 1;
+    pthread_mutex_unlock(&ponCache.lock);
+    return 0;
+}
+
+int toscaPonSnapshot(unsigned int* values)
+{
+    unsigned int seq;
+    int i;
+
+    if (!ponCache.running)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    do {
+        while ((seq = ponCache.seq) & 1);
+        __sync_synchronize();
+        for (i = 0; i < PON_NUM_REGS; i++)
+            values[i] = ponCache.regs[i];
+        __sync_synchronize();
+    } while (seq != ponCache.seq);
+    return 0;
+}
+
+unsigned int toscaPonReadCached(unsigned int address)
+{
+    unsigned int values[PON_NUM_REGS];
+    int index = toscaPonIndex(address);
+
+    if (index < 0 || index == PON_CFGDATA || toscaPonSnapshot(values) != 0)
+        return toscaPonRead(address);
+    errno = 0;
+    return values[index];
+}
+
+unsigned long long toscaPonSamplerUpdates(void)
+{
+    return ponCache.updates;
+}
+
+unsigned int toscaPonRead(unsigned int address)
+{
+    debug("address=0x%02x", address);
+    return toscaPonReadHw(address);
 }
 
 unsigned int toscaPonWriteMasked(unsigned int address, unsigned int mask, unsigned int value)
 {
-    debug("address=0x%02x value=0x%x", address, value);
-    int fd = toscaPonFd(address);
-    if (fd < 0) return (unsigned int)-1;
-    sysfsWrite(fd, "%x", (value & mask) | (sysfsReadULong(fd) & ~mask));
-    return sysfsReadULong(fd);
+    int index = toscaPonIndex(address);
+
+    debug("address=0x%02x mask=0x%x value=0x%x", address, mask, value);
+    if (index < 0)
+    {
+        errno = EINVAL;
+        return (unsigned int)-1;
+    }
+    pthread_mutex_lock(&ponCache.lock);
+    if (mask != 0xffffffff)
+    {
+        unsigned int old = toscaPonReadHw(address);
+        if (errno) goto fail;
+        value = (value & mask) | (old & ~mask);
+    }
+    if (toscaPonWriteHw(address, value) != 0) goto fail;
+    value = toscaPonReadHw(address);
+    if (errno) goto fail;
+    if (ponCache.running && index != PON_CFGDATA)
+        toscaPonCacheUpdate(index, value);
+    pthread_mutex_unlock(&ponCache.lock);
+    return value;
+fail:
+    pthread_mutex_unlock(&ponCache.lock);
+    return (unsigned int)-1;
+}
+
+unsigned int toscaPonWrite(unsigned int address, unsigned int value)
+{
+    return toscaPonWriteMasked(address, 0xffffffff, value);
 }
 
 unsigned int toscaPonSet(unsigned int address, unsigned int bitsToSet)
@@ -269,53 +987,101 @@ unsigned int toscaPonClear(unsigned int address, unsigned int bitsToClear)
 
 #define CSR_SERIAL_BUS_CONTROLER 0x120c /* 2 regs: address and value */
 #define FMC_MAX 2
+#define SBC_BUSY 0x80000000
+#define SBC_READ 0x8000000
+#define SBC_WRITE 0xc000000
 
-unsigned int toscaSbcWriteMasked(unsigned int fmc, unsigned int reg, unsigned int mask, unsigned int value)
+/* Waiting for the controller: spin first, then give up the CPU
+   with sched_yield and finally sleep with increasing intervals. */
+#define SBC_SPIN 100
+#define SBC_YIELD 20
+#define SBC_MAX_SLEEP_NS 1000000
+#define SBC_TIMEOUT_NS 100000000
+
+static int toscaSbcWait(volatile uint32_t* csr, int addr)
+{
+    struct timespec delay = { 0, 10000 };
+    long slept = 0;
+    int i;
+
+    for (i = 0; i < SBC_SPIN; i++)
+        if (!(le32toh(csr[addr]) & SBC_BUSY)) return 0;
+    for (i = 0; i < SBC_YIELD; i++)
+    {
+        sched_yield();
+        if (!(le32toh(csr[addr]) & SBC_BUSY)) return 0;
+    }
+    debugLvl(3, "SBC busy after %d spins and %d yields", SBC_SPIN, SBC_YIELD);
+    while (slept < SBC_TIMEOUT_NS)
+    {
+        nanosleep(&delay, NULL);
+        slept += delay.tv_nsec;
+        if (!(le32toh(csr[addr]) & SBC_BUSY)) return 0;
+        if (delay.tv_nsec < SBC_MAX_SLEEP_NS) delay.tv_nsec *= 2;
+    }
+    error("SBC timeout");
+    errno = EIO;
+    return -1;
+}
+
+size_t toscaSbcBatch(unsigned int fmc, toscaSbcOp* ops, size_t nops)
 {
     static pthread_mutex_t sbc_mutex[FMC_MAX] = {PTHREAD_MUTEX_INITIALIZER,PTHREAD_MUTEX_INITIALIZER};
     static volatile uint32_t* csr = (void*)-1;
-    int tries_left = 1000;
+    size_t i;
     int addr;
 
     if (fmc-1 >= FMC_MAX)
     {
         errno = ENODEV;
-        return -1;
+        return 0;
     }
     errno = 0;
     if (csr == (void*)-1) csr = toscaMap((toscaDeviceType(0) == 0x1211 ? 0x10000 : 0)|TOSCA_CSR, 0, 0, 0);
-    if (!csr) return (unsigned int)-1;
-    debug("fmc=%i, reg=0x%x, mask=0x%x, value=0x%x", fmc, reg, mask, value);
+    if (!csr) return 0;
     addr = (CSR_SERIAL_BUS_CONTROLER + --fmc * 0x100)/4;
     pthread_mutex_lock(&sbc_mutex[fmc]);
-    if (mask != 0xffffffff)
+    for (i = 0; i < nops; i++)
     {
-        csr[addr] = htole32(reg | 0x8000000); /* read cmd */
-        while ((le32toh(csr[addr]) & 0x80000000) && tries_left--); /* wait for read complete */
-        value &= mask;
-        value |= le32toh(csr[addr+1]) & ~mask;
-    }
-    if (mask != 0)
-    {
-        csr[addr+1] = htole32(value);
-        (void) csr[addr+1]; /* read back to flush */
-        csr[addr] = htole32(reg | 0xc000000); /* write cmd */
-        while ((le32toh(csr[addr]) & 0x80000000) && tries_left--); /* wait for write complete */
+        unsigned int reg = ops[i].reg;
+        unsigned int mask = ops[i].mask;
+        unsigned int value = ops[i].value;
 
-        /* read back value */
-        csr[addr] = htole32(reg | 0x8000000); /* read cmd */
-        while ((le32toh(csr[addr]) & 0x80000000) && tries_left--); /* wait for read complete */
-        value = le32toh(csr[addr+1]);
+        debug("fmc=%i, reg=0x%x, mask=0x%x, value=0x%x", fmc+1, reg, mask, value);
+        if (mask != 0xffffffff)
+        {
+            csr[addr] = htole32(reg | SBC_READ);
+            if (toscaSbcWait(csr, addr) != 0) break;
+            value &= mask;
+            value |= le32toh(csr[addr+1]) & ~mask;
+        }
+        if (mask != 0)
+        {
+            csr[addr+1] = htole32(value);
+            (void) csr[addr+1]; /* read back to flush */
+            csr[addr] = htole32(reg | SBC_WRITE);
+            if (toscaSbcWait(csr, addr) != 0) break;
+            if (ops[i].verify)
+            {
+                csr[addr] = htole32(reg | SBC_READ);
+                if (toscaSbcWait(csr, addr) != 0) break;
+                value = le32toh(csr[addr+1]);
+            }
+        }
+        debug("fmc=%i, reg=0x%x, readback=0x%x", fmc+1, reg, value);
+        ops[i].value = value;
     }
-    debug("fmc=%i, reg=0x%x, readback=0x%x", fmc, reg, value);
-    debugLvl(3, "tries_left: %i", tries_left);
     pthread_mutex_unlock(&sbc_mutex[fmc]);
-    if (tries_left == 0)
-    {
-        errno = EIO;
+    return i;
+}
+
+unsigned int toscaSbcWriteMasked(unsigned int fmc, unsigned int reg, unsigned int mask, unsigned int value)
+{
+    toscaSbcOp op = { .reg = reg, .mask = mask, .value = value, .verify = 1 };
+
+    if (toscaSbcBatch(fmc, &op, 1) != 1)
         return (unsigned int)-1;
-    }
-    return value;
+    return op.value;
 }
 
 unsigned int toscaSbcWrite(unsigned int fmc, unsigned int reg, unsigned int value)
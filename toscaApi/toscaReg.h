@@ -2,6 +2,7 @@
 #define toscaReg_h
 
 #include <stdint.h>
+#include <time.h>
 #include <stdio.h>
 
 #ifdef __cplusplus
@@ -55,6 +56,24 @@ unsigned int toscaSmonWriteMasked(unsigned int address, unsigned int mask, unsig
 unsigned int toscaSmonSet(unsigned int address, unsigned int bitsToSet);
 unsigned int toscaSmonClear(unsigned int address, unsigned int bitsToClear);
 
+/* Read all SMON registers 0x00-0x7f of a Tosca device every period seconds in a background thread.
+   The optional callback is called with usr after each update.
+   If the sampler already runs, only the callback is added to the others.
+   Writes with toscaSmonWrite* update the snapshot immediately.
+*/
+int toscaSmonSamplerStart(unsigned int device, double period, void (*callback)(void* usr), void* usr);
+
+/* Copy nregs registers starting at address from the sampler snapshot without hardware access.
+   Returns 0 or -1 with errno ENOENT if no sampler runs for the device.
+*/
+int toscaSmonSnapshot(unsigned int address, unsigned int nregs, unsigned int* values);
+
+/* Like toscaSmonRead, but from the snapshot if a sampler runs. */
+unsigned int toscaSmonReadCached(unsigned int address);
+
+/* Number of snapshots taken so far (0 if no sampler runs). */
+unsigned long long toscaSmonSamplerUpdates(unsigned int device);
+
 /* If you prefer to access Tosca CSR or IO directly using
    toscaMap instead of using functions above,
    be aware that all registers are little endian.
@@ -69,6 +88,33 @@ unsigned int toscaPonWriteMasked(unsigned int address, unsigned int mask, unsign
 unsigned int toscaPonSet(unsigned int address, unsigned int bitsToSet);
 unsigned int toscaPonClear(unsigned int address, unsigned int bitsToClear);
 
+/* The PON registers are accessed directly if the kernel provides a UIO device for them,
+   else through the sysfs files of the pon driver.
+   Writes return the value read back. */
+
+/* Read all 11 PON registers (0x00-0x24 and 0x40, in this order) in one call.
+   The cfgdata register (0x24) is not read and returned as 0.
+   Returns 0 or -1 with errno set on error. */
+int toscaPonReadAll(unsigned int* values);
+
+/* Read all PON registers every period seconds into memory in a background thread.
+   The optional callback is called when values have changed, with bit i of changed
+   set for register i (in the order of toscaPonReadAll).
+   Writes with the toscaPonWrite* functions update the cached values immediately.
+   If the sampler already runs, only a callback is attached (if it has none yet).
+*/
+int toscaPonSamplerStart(double period, void (*callback)(void* usr, unsigned int changed), void* usr);
+
+/* Copy all cached PON registers (like toscaPonReadAll) without hardware access.
+   Returns 0 or -1 with errno ENOENT if no sampler runs. */
+int toscaPonSnapshot(unsigned int* values);
+
+/* Like toscaPonRead, but from the cache if the sampler runs. */
+unsigned int toscaPonReadCached(unsigned int address);
+
+/* Number of samples taken so far. */
+unsigned long long toscaPonSamplerUpdates(void);
+
 /* Read (and clear) VME error status. Error is latched and not overwritten until read. */
 typedef struct {
     uint64_t address;         /* Lowest two bits are always 0. */
@@ -88,6 +134,45 @@ typedef struct {
 } toscaMapVmeErr_t;
 toscaMapVmeErr_t toscaGetVmeErr(unsigned int device);
 
+/* All errors read with toscaGetVmeErr are recorded in a ring buffer.
+   Any number of readers can read the events independently without locking.
+   Start with a cursor from toscaVmeErrCursor (0 for the oldest event
+   still in the ring). toscaVmeErrRead copies up to n newer events and
+   advances the cursor. Events overwritten before being read are skipped
+   (see gaps in seq).
+   toscaVmeErrMonitorStart connects to the VME-ERROR interrupt so that
+   all errors are recorded even if nobody calls toscaGetVmeErr.
+*/
+#define TOSCA_VME_ERR_RING_SIZE 256
+typedef struct {
+    uint64_t seq;              /* running number, starting with 1 */
+    struct timespec time;      /* when the error was read */
+    unsigned int device;
+    toscaMapVmeErr_t err;
+} toscaVmeErrEvent;
+uint64_t toscaVmeErrCursor(void);
+size_t toscaVmeErrRead(uint64_t* cursor, toscaVmeErrEvent* events, size_t n);
+int toscaVmeErrMonitorStart(void);
+
+/* Check if a VME error was caused by a CPU access to addrspace:address. */
+int toscaVmeErrMatches(toscaMapVmeErr_t err, unsigned int addrspace, uint64_t address, int isWrite);
+
+/* Probe a batch of VME addresses (all on the same Tosca device).
+   Reads (or writes) all candidates and checks the VME error latch only once
+   unless an error occurs.
+   Sets bit i in the present bitmap (n bits, rounded up to unsigned long)
+   if candidate i responded. Read values are returned in the candidates.
+   Returns the number of present candidates or -1 on error.
+*/
+typedef struct {
+    unsigned int addrspace;  /* VME_CRCSR, VME_A16, VME_A24, or VME_A32 (plus mode and device bits) */
+    uint64_t address;
+    unsigned int width;      /* 1, 2, or 4 bytes */
+    int write;               /* write value instead of reading */
+    uint32_t value;
+} toscaProbeCandidate;
+int toscaProbeBatch(toscaProbeCandidate* candidates, size_t n, unsigned long* present);
+
 /* Access to FMC 1 or 2 via TSCR Serial Bus Controller registers */
 unsigned int toscaSbcRead(unsigned int fmc_slot, unsigned int reg);
 unsigned int toscaSbcWrite(unsigned int fmc_slot, unsigned int reg, unsigned int value);
@@ -95,6 +180,18 @@ unsigned int toscaSbcWriteMasked(unsigned int fmc_slot, unsigned int reg, unsign
 unsigned int toscaSbcSet(unsigned int fmc_slot, unsigned int reg, unsigned int bitsToSet);
 unsigned int toscaSbcClear(unsigned int fmc_slot, unsigned int reg, unsigned int bitsToClear);
 
+/* Execute a batch of serial bus operations on one FMC in order, holding the bus only once.
+   Waiting for the controller spins only briefly, then yields the CPU or sleeps.
+   Returns the number of completed operations (< nops with errno set on failure).
+*/
+typedef struct {
+    unsigned int reg;
+    unsigned int mask;   /* 0: read, 0xffffffff: write, else: modify only the mask bits */
+    unsigned int value;  /* value to write, replaced with the register value */
+    int verify;          /* read back after write (else value is what was written) */
+} toscaSbcOp;
+size_t toscaSbcBatch(unsigned int fmc_slot, toscaSbcOp* ops, size_t nops);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "toscaMap.h"
+#include "toscaSlave.h"
+
+#define TOSCA_DEBUG_NAME toscaSlave
+#include "toscaDebug.h"
+
+/* Blocks have power of 2 sizes from 64 bytes to the window size and are
+   aligned to their size. Free blocks are kept in one list per size class.
+   New blocks are cut from the unused top of the window or by splitting
+   a larger free block. Freed blocks are not merged but reused for the
+   same size class. The size class of each allocated block is stored
+   in a map with one byte per 64 bytes of the window.
+   The free lists are kept outside the windows because SMEM or USER
+   windows may be slow to access or modified by other VME masters.
+*/
+
+#define MIN_SHIFT 6
+#define MAX_SHIFT 29 /* 512 MB */
+#define NUM_CLASSES (MAX_SHIFT - MIN_SHIFT + 1)
+#define MB 0x100000
+
+struct freeBlock {
+    struct freeBlock* next;
+    size_t offset;
+};
+
+struct toscaSlaveWindow {
+    unsigned int target;
+    volatile char* base;
+    uint64_t vmeaddress;
+    size_t size;
+    size_t top;
+    struct freeBlock* freelist[NUM_CLASSES];
+    unsigned char* classmap;
+    size_t used;
+    unsigned long allocs;
+    unsigned long frees;
+};
+
+static struct toscaSlaveWindow windows[TOSCA_SLAVE_MAX_WINDOWS];
+static unsigned int numWindows;
+static struct freeBlock* unusedBlocks;
+static pthread_mutex_t slaveLock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int toscaSlaveSizeClass(size_t size)
+{
+    unsigned int shift;
+
+    if (size <= 1UL << MIN_SHIFT) return 0;
+    shift = sizeof(unsigned long) * 8 - __builtin_clzl(size - 1);
+    return shift - MIN_SHIFT;
+}
+
+#define BLOCKSIZE(c) (1UL << ((c) + MIN_SHIFT))
+
+static int toscaSlavePush(struct toscaSlaveWindow* w, size_t offset, unsigned int c)
+{
+    struct freeBlock* b = unusedBlocks;
+
+    if (b)
+        unusedBlocks = b->next;
+    else if (!(b = malloc(sizeof(struct freeBlock))))
+        return -1;
+    b->offset = offset;
+    b->next = w->freelist[c];
+    w->freelist[c] = b;
+    return 0;
+}
+
+static size_t toscaSlavePop(struct toscaSlaveWindow* w, unsigned int c)
+{
+    struct freeBlock* b = w->freelist[c];
+
+    w->freelist[c] = b->next;
+    b->next = unusedBlocks;
+    unusedBlocks = b;
+    return b->offset;
+}
+
+int toscaSlaveWindowCreate(unsigned int target, uint64_t vmeaddress, size_t size, uint64_t res_address)
+{
+    struct toscaSlaveWindow* w;
+    volatile void* base;
+    unsigned int i, resource;
+
+    /* exact match: the SMEM2 bits include TOSCA_CSR */
+    resource = target & 0xffff;
+    if (resource != TOSCA_USER1 && resource != TOSCA_USER2 &&
+        resource != TOSCA_SMEM1 && resource != TOSCA_SMEM2)
+        resource = 0;
+    size = (size + MB - 1) & ~(MB - 1);
+    if (size == 0 || size > 1UL << MAX_SHIFT || (target & 0xffff) != resource
+        || (!resource && size > 4 * MB))
+    {
+        error("invalid target 0x%x or size 0x%zx", target, size);
+        errno = EINVAL;
+        return -1;
+    }
+    if (vmeaddress & (MB - 1))
+    {
+        error("address A32:0x%"PRIx64" must be MB aligned", vmeaddress);
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&slaveLock);
+    if (numWindows == TOSCA_SLAVE_MAX_WINDOWS)
+    {
+        pthread_mutex_unlock(&slaveLock);
+        error("too many windows");
+        errno = ENOSPC;
+        return -1;
+    }
+    for (i = 0; i < numWindows; i++)
+    {
+        if (vmeaddress < windows[i].vmeaddress + windows[i].size && vmeaddress + size > windows[i].vmeaddress)
+        {
+            pthread_mutex_unlock(&slaveLock);
+            error("A32:0x%"PRIx64" overlaps existing window", vmeaddress);
+            errno = EADDRINUSE;
+            return -1;
+        }
+    }
+    if (resource)
+    {
+        /* VME slave windows to Tosca resources return no pointer. Map the resource separately. */
+        errno = 0;
+        toscaMap(VME_SLAVE|VME_A32|target, vmeaddress, size, res_address);
+        base = errno ? NULL : toscaMap(target, res_address, size, 0);
+    }
+    else
+        base = toscaMap(VME_SLAVE|VME_A32, vmeaddress, size, 0);
+    if (!base)
+    {
+        pthread_mutex_unlock(&slaveLock);
+        debugErrno("toscaMap(SLAVE:0x%"PRIx64"->%s:0x%"PRIx64", 0x%zx)",
+            vmeaddress, target ? toscaAddrSpaceToStr(target) : "RAM", res_address, size);
+        return -1;
+    }
+    w = &windows[numWindows];
+    w->classmap = calloc(size >> MIN_SHIFT, 1);
+    if (!w->classmap)
+    {
+        pthread_mutex_unlock(&slaveLock);
+        return -1;
+    }
+    w->target = target;
+    w->vmeaddress = vmeaddress;
+    w->size = size;
+    w->top = 0;
+    w->base = base;
+    numWindows++;
+    pthread_mutex_unlock(&slaveLock);
+    debug("window A32:0x%"PRIx64" size 0x%zx to %s at %p",
+        vmeaddress, size, target ? toscaAddrSpaceToStr(target) : "RAM", base);
+    return 0;
+}
+
+int toscaSlavePoolConfigure(uint64_t vmeaddress, size_t size)
+{
+    return toscaSlaveWindowCreate(0, vmeaddress, size, 0);
+}
+
+static ssize_t toscaSlaveWindowAlloc(struct toscaSlaveWindow* w, unsigned int c)
+{
+    size_t offset, bs = BLOCKSIZE(c);
+    unsigned int k;
+
+    if (bs > w->size) return -1;
+    if (w->freelist[c])
+        offset = toscaSlavePop(w, c);
+    else
+    {
+        /* Try a larger free block first, then the top. */
+        for (k = c + 1; k < NUM_CLASSES && !w->freelist[k]; k++);
+        if (k < NUM_CLASSES)
+        {
+            offset = toscaSlavePop(w, k);
+            /* Keep the lower half, free the upper halves. */
+            while (k-- > c)
+                if (toscaSlavePush(w, offset + BLOCKSIZE(k), k) != 0)
+                    return -1;
+        }
+        else
+        {
+            /* Align the top, putting the gap into the free lists. */
+            while (w->top & (bs - 1))
+            {
+                size_t piece = w->top & -w->top;
+                if (w->top + piece > w->size) break;
+                if (toscaSlavePush(w, w->top, toscaSlaveSizeClass(piece)) != 0)
+                    return -1;
+                w->top += piece;
+            }
+            if (w->top + bs > w->size) return -1;
+            offset = w->top;
+            w->top += bs;
+        }
+    }
+    w->classmap[offset >> MIN_SHIFT] = c + 1;
+    w->used += bs;
+    w->allocs++;
+    return offset;
+}
+
+toscaSlaveBuf_t toscaSlaveAlloc(size_t size, unsigned int target)
+{
+    toscaSlaveBuf_t buf = { NULL, 0 };
+    unsigned int c, i;
+    int found = 0;
+    ssize_t offset;
+
+    if (size > 1UL << MAX_SHIFT)
+    {
+        errno = ENOMEM;
+        return buf;
+    }
+    c = toscaSlaveSizeClass(size);
+    pthread_mutex_lock(&slaveLock);
+    for (i = 0; i < numWindows; i++)
+    {
+        if (windows[i].target != target) continue;
+        found = 1;
+        offset = toscaSlaveWindowAlloc(&windows[i], c);
+        if (offset >= 0)
+        {
+            buf.ptr = windows[i].base + offset;
+            buf.vmeaddress = windows[i].vmeaddress + offset;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&slaveLock);
+    if (!buf.ptr)
+    {
+        debug("no space for size 0x%zx to %s", size, target ? toscaAddrSpaceToStr(target) : "RAM");
+        errno = found ? ENOMEM : ENXIO;
+        return buf;
+    }
+    debugLvl(2, "size 0x%zx: %p A32:0x%"PRIx64, size, buf.ptr, buf.vmeaddress);
+    return buf;
+}
+
+void* toscaSlaveMalloc(size_t size)
+{
+    return (void*) toscaSlaveAlloc(size, 0).ptr;
+}
+
+void toscaSlaveFree(volatile void* ptr)
+{
+    struct toscaSlaveWindow* w = NULL;
+    size_t offset = 0;
+    unsigned int c, i;
+
+    if (!ptr) return;
+    pthread_mutex_lock(&slaveLock);
+    for (i = 0; i < numWindows; i++)
+    {
+        offset = (volatile char*)ptr - windows[i].base;
+        if ((volatile char*)ptr >= windows[i].base && offset < windows[i].size)
+        {
+            w = &windows[i];
+            break;
+        }
+    }
+    if (!w || offset & ((1 << MIN_SHIFT) - 1) || !(c = w->classmap[offset >> MIN_SHIFT]))
+    {
+        pthread_mutex_unlock(&slaveLock);
+        error("%p is not allocated from a slave window", ptr);
+        return;
+    }
+    c--;
+    if (toscaSlavePush(w, offset, c) != 0)
+    {
+        /* Out of memory for the free list: block stays allocated. */
+        pthread_mutex_unlock(&slaveLock);
+        debugErrno("free %p", ptr);
+        return;
+    }
+    w->classmap[offset >> MIN_SHIFT] = 0;
+    w->used -= BLOCKSIZE(c);
+    w->frees++;
+    pthread_mutex_unlock(&slaveLock);
+    debugLvl(2, "%p", ptr);
+}
+
+toscaSlavePoolInfo_t toscaSlavePoolInfo(unsigned int index)
+{
+    toscaSlavePoolInfo_t info = {0};
+
+    pthread_mutex_lock(&slaveLock);
+    if (index < numWindows)
+    {
+        info.target = windows[index].target;
+        info.vmeaddress = windows[index].vmeaddress;
+        info.size = windows[index].size;
+        info.used = windows[index].used;
+        info.allocs = windows[index].allocs;
+        info.frees = windows[index].frees;
+    }
+    pthread_mutex_unlock(&slaveLock);
+    return info;
+}
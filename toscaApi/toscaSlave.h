@@ -0,0 +1,72 @@
+#ifndef toscaSlave_h
+#define toscaSlave_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* set to 1 to see debug output */
+extern int toscaSlaveDebug;
+
+/* set to redirect debug output  */
+extern FILE* toscaSlaveDebugFile;
+
+/* Slave window manager: Buffers which other VME masters access (e.g. with DMA
+   or as mailboxes) are allocated from a few large VME A32 slave windows instead
+   of using up one (at least 1 MB sized, never released) slave window each.
+
+   Create a window of size bytes (rounded up to full MB) at VME address vmeaddress.
+   For target use 0 for program memory (max 4 MB) or one of TOSCA_USER1, TOSCA_USER2,
+   TOSCA_SMEM1, TOSCA_SMEM2 ( | device<<16) and pass res_address on that resource
+   (same offset from 1 MB alignment as vmeaddress).
+   Up to TOSCA_SLAVE_MAX_WINDOWS windows can be created, also for the same target.
+   Tosca has no A24 slave windows, thus the buffers are only visible in A32.
+   Returns 0 on success or -1 with errno set.
+*/
+#define TOSCA_SLAVE_MAX_WINDOWS 8
+int toscaSlaveWindowCreate(unsigned int target, uint64_t vmeaddress, size_t size, uint64_t res_address);
+
+/* Shortcut for a window to program memory. */
+int toscaSlavePoolConfigure(uint64_t vmeaddress, size_t size);
+
+/* Allocate a buffer from a window to target, aligned to its size rounded up to
+   a power of 2 (min 64 bytes).
+   Allocation and release are O(1) using free lists per size class.
+   Returns the CPU pointer and the VME A32 address of the buffer.
+   On failure ptr is NULL and errno is set to ENOMEM if all windows to target are
+   exhausted or to ENXIO if no window to target has been created.
+*/
+typedef struct {
+    volatile void* ptr;
+    uint64_t vmeaddress;
+} toscaSlaveBuf_t;
+
+toscaSlaveBuf_t toscaSlaveAlloc(size_t size, unsigned int target);
+
+/* Release a buffer allocated with toscaSlaveAlloc() or toscaSlaveMalloc(). */
+void toscaSlaveFree(volatile void* ptr);
+
+/* Allocate from program memory windows. Use toscaMapLookupAddr() to get the VME address. */
+void* toscaSlaveMalloc(size_t size);
+
+/* Window usage by index (size is 0 if index is not used). */
+typedef struct {
+    unsigned int target;
+    uint64_t vmeaddress;
+    size_t size;
+    size_t used;
+    unsigned long allocs;
+    unsigned long frees;
+} toscaSlavePoolInfo_t;
+
+toscaSlavePoolInfo_t toscaSlavePoolInfo(unsigned int index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,12 +1,12 @@
 #include <stdlib.h>
 
 #include <devLibVME.h>
-#include <epicsMutex.h>
 #include <epicsTypes.h>
 
 #include "toscaMap.h"
 #include "toscaIntr.h"
 #include "toscaReg.h"
+#include "toscaSlave.h"
 
 #include <epicsExport.h>
 
@@ -111,8 +111,6 @@ long toscaDevLibMapAddr(
 
 /** VME probing *****************/
 
-epicsMutexId probeMutex;
-
 long toscaDevLibProbe(
     int isWrite,
     unsigned int wordSize,
@@ -120,106 +118,39 @@ long toscaDevLibProbe(
     void *pValue)
 {
     toscaMapAddr_t vme_addr;
-    toscaMapVmeErr_t vme_err;
-    void* readptr;
-    unsigned int device;
-    unsigned int i;
-    epicsUInt32 readval;
-
-    if (isWrite)
-        readptr = &readval;
-    else
-        readptr = pValue;
+    toscaProbeCandidate c;
+    unsigned long present;
 
     vme_addr = toscaMapLookupAddr(ptr);
-
     if (!vme_addr.addrspace) return S_dev_addressNotFound;
 
-    device = vme_addr.addrspace>>16;
-
-    epicsMutexMustLock(probeMutex);
-
-    /* Read once to clear BERR bit. */
-    toscaGetVmeErr(device);
-
-    for (i = 1; i < 1000; i++)  /* We don't want to loop forever. */
+    c.addrspace = vme_addr.addrspace;
+    c.address = vme_addr.address;
+    c.width = wordSize;
+    c.write = isWrite;
+    switch (wordSize)
     {
-        switch (wordSize)
-        {
-            case 1:
-                if (isWrite)
-                    *(epicsUInt8 *)(ptr) = *(epicsUInt8 *)pValue;
-                else
-                *(epicsUInt8 *)readptr = *(epicsUInt8 *)(ptr);
-                break;
-            case 2:
-                if (isWrite)
-                    *(epicsUInt16 *)(ptr) = *(epicsUInt16 *)pValue;
-                else
-                *(epicsUInt16 *)readptr = *(epicsUInt16 *)(ptr);
-                break;
-            case 4:
-                if (isWrite)
-                    *(epicsUInt32 *)(ptr) = *(epicsUInt32 *)pValue;
-                else
-                *(epicsUInt32 *)readptr = *(epicsUInt32 *)(ptr);
-                break;
-            default:
-                epicsMutexUnlock(probeMutex);
-                return S_dev_badArgument;
-        }
-        vme_err = toscaGetVmeErr(device);
-        if (!vme_err.err) break; /* No error: success */
-
-        /* Now check if the error came from our access. */
-        debug("Our access was %s 0x%"PRIx64,
-            toscaAddrSpaceToStr(vme_addr.addrspace),
-             vme_addr.address);
-        if (vme_err.source == 0 && /* Error from PCIe, maybe our access. */
-            isWrite == vme_err.write) /* Read/write access matches. */
-            switch (vme_err.mode) /* Check address space of error. */
-            {
-                case 0: /* CRCSR */
-                    debug("VME bus error at CRCSR 0x%"PRIx64, vme_err.address & 0xfffffc);
-                    if ((vme_addr.addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_CRCSR &&
-                        ((vme_err.address ^ vme_addr.address) & 0xfffffc) == 0)
-                    {
-                        epicsMutexUnlock(probeMutex);
-                        return S_dev_noDevice;
-                    }
-                    break;
-                case 1: /* A16 */
-                    debug("VME bus error at A16 0x%"PRIx64, vme_err.address & 0xfffc);
-                    if ((vme_addr.addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_A16 &&
-                        ((vme_err.address ^ vme_addr.address) & 0xfffc) == 0)
-                    {
-                        epicsMutexUnlock(probeMutex);
-                        return S_dev_noDevice;
-                    }
-                    break;
-                case 2: /* A24 */
-                    debug("VME bus error at A24 0x%"PRIx64, vme_err.address & 0xfffffc);
-                    if ((vme_addr.addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_A24 &&
-                        ((vme_err.address ^ vme_addr.address) & 0xfffffc) == 0)
-                    {
-                        epicsMutexUnlock(probeMutex);
-                        return S_dev_noDevice;
-                    }
-                    break;
-                case 3: /* A32 */
-                    debug("VME bus error at A32 0x%"PRIx64, vme_err.address & 0xfffffffc);
-                    if ((vme_addr.addrspace & (VME_CRCSR|VME_A16|VME_A24|VME_A32)) == VME_A32 &&
-                        ((vme_err.address ^ vme_addr.address) & 0xfffffffc) == 0)
-                    {
-                        epicsMutexUnlock(probeMutex);
-                        return S_dev_noDevice;
-                    }
-                    break;
-            }
-        debug("try again i=%d", i);
-    } /* Repeat until success or error matches our address */
-    /* ...or give up. All errors have always been on other addresses so far. */
-    epicsMutexUnlock(probeMutex);
+        case 1: c.value = isWrite ? *(epicsUInt8 *)pValue : 0; break;
+        case 2: c.value = isWrite ? *(epicsUInt16 *)pValue : 0; break;
+        case 4: c.value = isWrite ? *(epicsUInt32 *)pValue : 0; break;
+        default: return S_dev_badArgument;
+    }
+    if (toscaProbeBatch(&c, 1, &present) < 0)
+    {
+        debugErrno("toscaProbeBatch %s:0x%"PRIx64, toscaAddrSpaceToStr(c.addrspace), c.address);
+        return S_dev_badArgument;
+    }
+    if (!present)
+    {
+        debug("VME bus error at %s:0x%"PRIx64, toscaAddrSpaceToStr(c.addrspace), c.address);
+        return S_dev_noDevice;
+    }
+    if (!isWrite) switch (wordSize)
+    {
+        case 1: *(epicsUInt8 *)pValue = c.value; break;
+        case 2: *(epicsUInt16 *)pValue = c.value; break;
+        case 4: *(epicsUInt32 *)pValue = c.value; break;
+    }
     return S_dev_success;
 }
 
@@ -287,16 +218,23 @@ int toscaDevLibInterruptInUseVME(unsigned int vec __attribute__((unused)))
 
 /** VME A24 DMA memory *****************/
 
-void *toscaDevLibA24Malloc(size_t size __attribute__((unused)))
+void *toscaDevLibA24Malloc(size_t size)
 {
     /* This function should allocate some DMA capable memory
      * and map it into a A24 slave window.
      * But TOSCA supports only A32 slave windows.
+     * Thus allocate from the A32 slave pool (if configured).
      */
-    return NULL;
+    void* ptr = toscaSlaveMalloc(size);
+    debug("size=0x%zx: %p", size, ptr);
+    return ptr;
 }
 
-void toscaDevLibA24Free(void *pBlock __attribute__((unused))) {};
+void toscaDevLibA24Free(void *pBlock)
+{
+    debug("%p", pBlock);
+    toscaSlaveFree(pBlock);
+}
 
 
 /** Initialization *****************/
@@ -328,7 +266,6 @@ devLibVirtualOS toscaVirtualOS = {
 
 static void toscaDevLibRegistrar ()
 {
-    probeMutex = epicsMutexMustCreate();
     pdevLibVirtualOS = &toscaVirtualOS;
 }
 
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+
+#include <regDev.h>
+
+#include <iocsh.h>
+#include <epicsStdioRedirect.h>
+#include <epicsExport.h>
+
+#include "toscaIntr.h"
+
+#define TOSCA_EXTERN_DEBUG
+#define TOSCA_DEBUG_NAME toscaIntr
+#include "toscaDebug.h"
+
+/* Memory layout of the stats block:
+   0x0000: total count, then counts of each interrupt index (64 bit integers)
+   0x4000: total rate, then rates of each interrupt index (64 bit floats, per second)
+*/
+#define STATS_COUNT_OFFSET 0x0000
+#define STATS_RATE_OFFSET  0x4000
+#define STATS_SIZE         0x8000
+
+struct regDevice
+{
+    epicsMutexId lock;
+    double interval;
+    struct timespec time;
+    unsigned long long total;
+    unsigned long long counts[TOSCA_NUM_INTR];
+    unsigned long long newcounts[TOSCA_NUM_INTR];
+    epicsFloat64 rates[1+TOSCA_NUM_INTR];
+};
+
+void toscaIntrStatsDevReport(regDevice *device, int level __attribute__((unused)))
+{
+    printf("Tosca interrupt statistics, rates averaged over %g s\n", device->interval);
+}
+
+static void toscaIntrStatsUpdateRates(regDevice *device)
+{
+    unsigned long long* counts = device->newcounts; /* protected by device lock */
+    unsigned long long total;
+    struct timespec now;
+    double dt;
+    unsigned int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    dt = (now.tv_sec - device->time.tv_sec) + (now.tv_nsec - device->time.tv_nsec) * 1e-9;
+    if (dt < device->interval) return;
+    total = toscaIntrCountSnapshot(counts);
+    device->rates[0] = (total - device->total) / dt;
+    for (i = 0; i < TOSCA_NUM_INTR; i++)
+        device->rates[1+i] = (counts[i] - device->counts[i]) / dt;
+    memcpy(device->counts, counts, sizeof(device->counts));
+    device->total = total;
+    device->time = now;
+}
+
+int toscaIntrStatsDevRead(
+    regDevice *device,
+    size_t offset,
+    unsigned int dlen,
+    size_t nelem,
+    void* pdata,
+    int priority __attribute__((unused)),
+    regDevTransferComplete callback __attribute__((unused)),
+    const char* user)
+{
+    size_t i;
+
+    if (dlen != 8)
+    {
+        error("%s %s: only 8 bytes supported", user, regDevName(device));
+        return -1;
+    }
+    if (offset & 7)
+    {
+        error("%s %s: offset must be multiple of 8", user, regDevName(device));
+        return -1;
+    }
+    if (offset < STATS_RATE_OFFSET)
+    {
+        offset = (offset - STATS_COUNT_OFFSET) >> 3;
+        if (offset + nelem > 1+TOSCA_NUM_INTR)
+        {
+            error("%s %s: out of range", user, regDevName(device));
+            return -1;
+        }
+        for (i = 0; i < nelem; i++, offset++)
+            ((uint64_t*)pdata)[i] = offset == 0 ? toscaIntrCount() : toscaIntrIndexCount(offset-1);
+    }
+    else
+    {
+        offset = (offset - STATS_RATE_OFFSET) >> 3;
+        if (offset + nelem > 1+TOSCA_NUM_INTR)
+        {
+            error("%s %s: out of range", user, regDevName(device));
+            return -1;
+        }
+        epicsMutexMustLock(device->lock);
+        toscaIntrStatsUpdateRates(device);
+        memcpy(pdata, device->rates + offset, nelem * 8);
+        epicsMutexUnlock(device->lock);
+    }
+    return 0;
+}
+
+struct regDevSupport toscaIntrStatsDevRegDev = {
+    .report = toscaIntrStatsDevReport,
+    .read = toscaIntrStatsDevRead,
+};
+
+int toscaIntrStatsDevConfigure(const char* name, double interval)
+{
+    regDevice *device = NULL;
+
+    if (!name || !name[0])
+    {
+        printf("usage: toscaIntrStatsDevConfigure name [interval_sec]\n");
+        return -1;
+    }
+    device = calloc(1, sizeof(regDevice));
+    if (!device)
+    {
+        fprintf(stderr, "malloc regDevice failed: %m\n");
+        return -1;
+    }
+    device->lock = epicsMutexMustCreate();
+    device->interval = interval > 0 ? interval : 1.0;
+    clock_gettime(CLOCK_MONOTONIC, &device->time);
+    device->total = toscaIntrCountSnapshot(device->counts);
+    errno = 0;
+    if (regDevRegisterDevice(name, &toscaIntrStatsDevRegDev, device, STATS_SIZE) != SUCCESS)
+    {
+        if (errno) fprintf(stderr, "regDevRegisterDevice failed: %m\n");
+        free(device);
+        return -1;
+    }
+    return 0;
+}
+
+static const iocshFuncDef toscaIntrStatsDevConfigureDef =
+    { "toscaIntrStatsDevConfigure", 2, (const iocshArg *[]) {
+    &(iocshArg) { "name", iocshArgString },
+    &(iocshArg) { "interval_sec", iocshArgDouble },
+}};
+
+static void toscaIntrStatsDevConfigureFunc(const iocshArgBuf *args)
+{
+    toscaIntrStatsDevConfigure(args[0].sval, args[1].dval);
+}
+
+static void toscaIntrStatsRegistrar(void)
+{
+    iocshRegister(&toscaIntrStatsDevConfigureDef, toscaIntrStatsDevConfigureFunc);
+}
+
+epicsExportRegistrar(toscaIntrStatsRegistrar);
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
 
 #include <epicsTypes.h>
 #include <epicsStdio.h>
@@ -16,6 +17,8 @@
 #include "toscaReg.h"
 #include "toscaIntr.h"
 #include "toscaDma.h"
+#include "toscaCopy.h"
+#include "toscaSlave.h"
 #include "toscaInit.h"
 
 #include <epicsStdioRedirect.h>
@@ -142,6 +145,84 @@ static void toscaMapFunc(const iocshArgBuf *args)
     printf("%p\n", ptr);
 }
 
+static const iocshFuncDef toscaUnmapDef =
+    { "toscaUnmap", 1, (const iocshArg *[]) {
+    &(iocshArg) { "address", iocshArgString },
+}};
+
+static void toscaUnmapFunc(const iocshArgBuf *args)
+{
+    if (!args[0].sval)
+    {
+        iocshCmd("help toscaUnmap");
+        return;
+    }
+    if (toscaUnmap((void*)toscaStrToSize(args[0].sval)) != 0)
+        fprintf(stderr, "%m\n");
+}
+
+static const iocshFuncDef toscaMapPlanDef =
+    { "toscaMapPlan", 2, (const iocshArg *[]) {
+    &(iocshArg) { "addrspace:address", iocshArgString },
+    &(iocshArg) { "size", iocshArgString },
+}};
+
+static void toscaMapPlanFunc(const iocshArgBuf *args)
+{
+    toscaMapAddr_t addr;
+    ssize_t size = 0;
+
+    if (!args[0].sval)
+    {
+        /* No more requests: create all maps. */
+        if (toscaMapPlanExecute() != 0)
+            fprintf(stderr, "%m\n");
+        return;
+    }
+    addr = toscaStrToAddr(args[0].sval, NULL);
+    if (!addr.addrspace)
+    {
+        fprintf(stderr, "invalid Tosca address %s\n", args[0].sval);
+        return;
+    }
+    if (args[1].sval)
+    {
+        size = toscaStrToSize(args[1].sval);
+        if (size < 0)
+        {
+            fprintf(stderr, "invalid size %s\n", args[1].sval);
+            return;
+        }
+    }
+    if (toscaMapPlanAdd(addr.addrspace, addr.address, size) != 0)
+        fprintf(stderr, "%m\n");
+}
+
+static const iocshFuncDef toscaMapPrefaultDef =
+    { "toscaMapPrefault", 2, (const iocshArg *[]) {
+    &(iocshArg) { "address", iocshArgString },
+    &(iocshArg) { "size", iocshArgString },
+}};
+
+static void toscaMapPrefaultFunc(const iocshArgBuf *args)
+{
+    struct timespec t0, t1;
+
+    if (!args[0].sval)
+    {
+        iocshCmd("help toscaMapPrefault");
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (toscaMapPrefault((void*)toscaStrToSize(args[0].sval), args[1].sval ? toscaStrToSize(args[1].sval) : 0) != 0)
+    {
+        fprintf(stderr, "%m\n");
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("%.3f ms\n", (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) * 1e-6);
+}
+
 static const iocshFuncDef toscaMapLookupAddrDef =
     { "toscaMapLookupAddr", 1, (const iocshArg *[]) {
     &(iocshArg) { "address", iocshArgString },
@@ -159,6 +240,71 @@ static void toscaMapLookupAddrFunc(const iocshArgBuf *args)
             vme_addr.address);
 }
 
+static const iocshFuncDef toscaSlavePoolConfigureDef =
+    { "toscaSlavePoolConfigure", 2, (const iocshArg *[]) {
+    &(iocshArg) { "vmeaddress", iocshArgString },
+    &(iocshArg) { "size", iocshArgString },
+}};
+
+static void toscaSlavePoolConfigureFunc(const iocshArgBuf *args)
+{
+    if (!args[0].sval || !args[1].sval)
+    {
+        iocshCmd("help toscaSlavePoolConfigure");
+        return;
+    }
+    if (toscaSlavePoolConfigure(toscaStrToSize(args[0].sval), toscaStrToSize(args[1].sval)) != 0)
+        fprintf(stderr, "%m\n");
+}
+
+static const iocshFuncDef toscaSlaveWindowCreateDef =
+    { "toscaSlaveWindowCreate", 4, (const iocshArg *[]) {
+    &(iocshArg) { "[device:](RAM|USER[1|2]|SMEM[1|2])", iocshArgString },
+    &(iocshArg) { "vmeaddress", iocshArgString },
+    &(iocshArg) { "size", iocshArgString },
+    &(iocshArg) { "res_address", iocshArgString },
+}};
+
+static void toscaSlaveWindowCreateFunc(const iocshArgBuf *args)
+{
+    unsigned int target = 0;
+
+    if (!args[0].sval || !args[1].sval || !args[2].sval)
+    {
+        iocshCmd("help toscaSlaveWindowCreate");
+        return;
+    }
+    if (strcasecmp(args[0].sval, "RAM") != 0)
+    {
+        target = toscaStrToAddrSpace(args[0].sval, NULL);
+        if (!target)
+        {
+            fprintf(stderr, "invalid target %s\n", args[0].sval);
+            return;
+        }
+    }
+    if (toscaSlaveWindowCreate(target, toscaStrToSize(args[1].sval), toscaStrToSize(args[2].sval),
+        args[3].sval ? toscaStrToSize(args[3].sval) : 0) != 0)
+        fprintf(stderr, "%m\n");
+}
+
+static const iocshFuncDef toscaSlavePoolShowDef =
+    { "toscaSlavePoolShow", 0, (const iocshArg *[]) {
+}};
+
+static void toscaSlavePoolShowFunc(const iocshArgBuf *args __attribute__((unused)))
+{
+    toscaSlavePoolInfo_t info;
+    unsigned int i;
+
+    for (i = 0; (info = toscaSlavePoolInfo(i)).size; i++)
+        printf("A32:0x%-8"PRIx64" -> %-7s size 0x%-7zx used 0x%-7zx allocs %lu frees %lu\n",
+            info.vmeaddress, info.target ? toscaAddrSpaceToStr(info.target) : "RAM",
+            info.size, info.used, info.allocs, info.frees);
+    if (i == 0)
+        printf("no slave windows created\n");
+}
+
 int toscaMapPrintInfo(toscaMapInfo_t info, void* unused __attribute__((unused)))
 {
     unsigned int device = info.addrspace >> 16;
@@ -215,15 +361,8 @@ static const iocshFuncDef toscaGetVmeErrDef =
     &(iocshArg) { "device", iocshArgInt },
 }};
 
-static void toscaGetVmeErrFunc(const iocshArgBuf *args)
+static void toscaVmeErrPrint(toscaMapVmeErr_t err)
 {
-    errno = 0;
-    toscaMapVmeErr_t err = toscaGetVmeErr(args[0].ival);
-    if (errno)
-    {
-        fprintf(stderr, "%m\n");
-        return;
-    }
     printf("0x%08"PRIx64",0x%"PRIx32" (%s %s%c%s %s id=%d len=%d %s:0x%"PRIx64")\n",
         err.address,
         err.status,
@@ -239,6 +378,113 @@ static void toscaGetVmeErrFunc(const iocshArgBuf *args)
         );
 }
 
+static void toscaGetVmeErrFunc(const iocshArgBuf *args)
+{
+    errno = 0;
+    toscaMapVmeErr_t err = toscaGetVmeErr(args[0].ival);
+    if (errno)
+    {
+        fprintf(stderr, "%m\n");
+        return;
+    }
+    toscaVmeErrPrint(err);
+}
+
+static const iocshFuncDef toscaVmeErrMonitorStartDef =
+    { "toscaVmeErrMonitorStart", 0, (const iocshArg *[]) {
+}};
+
+static void toscaVmeErrMonitorStartFunc(const iocshArgBuf *args __attribute__((unused)))
+{
+    if (toscaVmeErrMonitorStart() != 0)
+        fprintf(stderr, "%m\n");
+}
+
+static const iocshFuncDef toscaVmeErrShowDef =
+    { "toscaVmeErrShow", 1, (const iocshArg *[]) {
+    &(iocshArg) { "count", iocshArgInt },
+}};
+
+static void toscaVmeErrShowFunc(const iocshArgBuf *args)
+{
+    uint64_t cursor = toscaVmeErrCursor();
+    unsigned int count = args[0].ival > 0 ? args[0].ival : 10;
+    toscaVmeErrEvent event;
+    struct tm tm;
+    char timestr[32];
+
+    cursor = cursor > count ? cursor - count : 0;
+    while (toscaVmeErrRead(&cursor, &event, 1))
+    {
+        strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", localtime_r(&event.time.tv_sec, &tm));
+        printf("%6"PRIu64" %s.%06ld %u: ", event.seq, timestr, event.time.tv_nsec / 1000, event.device);
+        toscaVmeErrPrint(event.err);
+    }
+}
+
+static const iocshFuncDef toscaVmeScanDef =
+    { "toscaVmeScan", 1, (const iocshArg *[]) {
+    &(iocshArg) { "device", iocshArgInt },
+}};
+
+/* VME64x configuration ROM: one byte in every 4 */
+#define CR_SLOTS 21
+#define CR_SLOT_SIZE 0x80000
+#define CR_C 0x1f  /* 'C' */
+#define CR_ID 0x23 /* 'R', 3 bytes manufacturer, 4 bytes board, 4 bytes revision */
+#define CR_ID_BYTES 12
+
+static void toscaVmeScanFunc(const iocshArgBuf *args)
+{
+    unsigned int addrspace = args[0].ival << 16 | VME_CRCSR;
+    toscaProbeCandidate cand[CR_SLOTS * CR_ID_BYTES];
+    unsigned long present[(CR_SLOTS * CR_ID_BYTES + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long))];
+    unsigned int slots[CR_SLOTS];
+    unsigned int slot, i, j, n;
+
+    /* First look for the 'C' of the CR signature in all slots */
+    for (slot = 1; slot <= CR_SLOTS; slot++)
+        cand[slot-1] = (toscaProbeCandidate) { .addrspace = addrspace, .address = slot * CR_SLOT_SIZE + CR_C, .width = 1 };
+    if (toscaProbeBatch(cand, CR_SLOTS, present) < 0)
+    {
+        fprintf(stderr, "toscaProbeBatch failed: %m\n");
+        return;
+    }
+    for (n = 0, i = 0; i < CR_SLOTS; i++)
+        if (present[i / (8 * sizeof(unsigned long))] & (1UL << (i % (8 * sizeof(unsigned long)))))
+            slots[n++] = i + 1;
+    if (n == 0)
+    {
+        printf("no VME64x boards found\n");
+        return;
+    }
+
+    /* Then read the IDs of all occupied slots in one batch */
+    for (i = 0; i < n; i++)
+        for (j = 0; j < CR_ID_BYTES; j++)
+            cand[i * CR_ID_BYTES + j] = (toscaProbeCandidate) { .addrspace = addrspace,
+                .address = slots[i] * CR_SLOT_SIZE + CR_ID + 4 * j, .width = 1 };
+    if (toscaProbeBatch(cand, n * CR_ID_BYTES, present) < 0)
+    {
+        fprintf(stderr, "toscaProbeBatch failed: %m\n");
+        return;
+    }
+    printf("slot manufacturer board      revision\n");
+    for (i = 0; i < n; i++)
+    {
+        toscaProbeCandidate* c = &cand[i * CR_ID_BYTES];
+        if (c[0].value != 'R')
+        {
+            printf("%4u (no CR signature)\n", slots[i]);
+            continue;
+        }
+        printf("%4u 0x%06x     0x%08x 0x%08x\n", slots[i],
+            c[1].value << 16 | c[2].value << 8 | c[3].value,
+            c[4].value << 24 | c[5].value << 16 | c[6].value << 8 | c[7].value,
+            c[8].value << 24 | c[9].value << 16 | c[10].value << 8 | c[11].value);
+    }
+}
+
 static const iocshFuncDef toscaReadDef =
     { "toscaRead", 1, (const iocshArg *[]) {
     &(iocshArg) { "[device:]addrspace:address", iocshArgString },
@@ -704,6 +950,53 @@ static void toscaIntrDisableFunc(const iocshArgBuf *args)
     if (toscaIntrDisable(mask) != 0) fprintf(stderr, "%m\n");
 }
 
+static const iocshFuncDef toscaIntrWaitDef =
+    { "toscaIntrWait", 3, (const iocshArg *[]) {
+    &(iocshArg) { "intmask", iocshArgString },
+    &(iocshArg) { "timeout_ms", iocshArgInt },
+    &(iocshArg) { "count", iocshArgInt },
+}};
+
+static void toscaIntrWaitFunc(const iocshArgBuf *args)
+{
+    intrmask_t mask = toscaStrToIntrMask(args[0].sval);
+    int timeout = args[1].ival ? args[1].ival : -1;
+    int count = args[2].ival ? args[2].ival : 1;
+    struct toscaIntrWaiter* waiter;
+    toscaIntrWaitInfo_t info;
+
+    if (!args[0].sval)
+    {
+        iocshCmd("help toscaIntrWait");
+        printf(maskhelp);
+        return;
+    }
+    if (!mask)
+    {
+        fprintf(stderr, "Invalid mask \"%s\"\n" , args[0].sval);
+        fprintf(stderr, maskhelp);
+        return;
+    }
+    waiter = toscaIntrWaitCreate(mask);
+    if (!waiter)
+    {
+        fprintf(stderr, "%m\n");
+        return;
+    }
+    while (count-- > 0)
+    {
+        if (toscaIntrWait(waiter, timeout, &info) != 0)
+        {
+            fprintf(stderr, "%m\n");
+            break;
+        }
+        printf("%s inum=%u ivec=%u", toscaIntrBitToStr(info.intrmaskbit), info.inum, info.ivec);
+        if (info.lost) printf(" (%llu lost)", info.lost);
+        printf("\n");
+    }
+    toscaIntrWaitRelease(waiter);
+}
+
 static const iocshFuncDef toscaSendVMEIntrDef =
     { "toscaSendVMEIntr", 2, (const iocshArg *[]) {
     &(iocshArg) { "level(1-7)", iocshArgInt },
@@ -733,70 +1026,134 @@ static const iocshFuncDef toscaDmaTransferDef =
     &(iocshArg) { "timeout(0:block|-1:nowait|ms)", iocshArgInt },
 }};
 
-static void toscaDmaTransferFunc(const iocshArgBuf *args)
+static int toscaDmaParseArgs(const iocshArgBuf *args,
+    int* source, size_t* source_addr, int* dest, size_t* dest_addr, size_t* size, int* swap)
 {
-    int source = 0, dest = 0, swap = 0;
-    size_t source_addr, dest_addr, size;
     const char *s;
 
-    if (!args[0].sval || !args[1].sval)
-    {
-        iocshCmd("help toscaDmaTransfer");
-        printf("addrspaces: USER[1|2], SMEM[1|2], A32, BLT, MBLT, 2eVME, 2eVMEFast, 2eSST(160|267|320)\n");
-        return;
-    }
-
-    source = toscaStrToDmaSpace(args[0].sval, &s);
-    source_addr = toscaStrToSize(s);
-    if (source == -1 && source_addr == -1)
+    *source = toscaStrToDmaSpace(args[0].sval, &s);
+    *source_addr = toscaStrToSize(s);
+    if (*source == -1 && *source_addr == -1)
     {
         fprintf(stderr, "Invalid DMA source \"%s\"\n", args[0].sval);
-        return;
+        return -1;
     }
-    if (source == -1) source = 0;
+    if (*source == -1) *source = 0;
 
-    dest = toscaStrToDmaSpace(args[1].sval, &s);
-    dest_addr = toscaStrToSize(s);
-    if (dest == -1 && dest_addr == -1)
+    *dest = toscaStrToDmaSpace(args[1].sval, &s);
+    *dest_addr = toscaStrToSize(s);
+    if (*dest == -1 && *dest_addr == -1)
     {
         fprintf(stderr, "Invalid DMA dest \"%s\"\n", s);
-        return;
+        return -1;
     }
-    if (dest == -1) dest = 0;
+    if (*dest == -1) *dest = 0;
 
-    size = toscaStrToSize(args[2].sval);
-    if (size == -1)
+    *size = toscaStrToSize(args[2].sval);
+    if (*size == -1)
     {
         fprintf(stderr, "Invalid size \"%s\"\n", args[2].sval);
-        return;
+        return -1;
     }
 
+    *swap = 0;
     if (args[3].sval)
     {
         if (strcasecmp(args[3].sval, "NS") == 0)
-            swap = 0;
+            *swap = 0;
         else
         if (strcasecmp(args[3].sval, "WS") == 0)
-            swap = 2;
+            *swap = 2;
         else
         if (strcasecmp(args[3].sval, "DS") == 0)
-            swap = 4;
+            *swap = 4;
         else
         if (strcasecmp(args[3].sval, "QS") == 0)
-            swap = 8;
+            *swap = 8;
         else
         {
             fprintf(stderr, "Invalid swap \"%s\", must be WS, DS, or QS\n",
                 args[3].sval);
-            return;
+            return -1;
         }
     }
+    return 0;
+}
+
+static void toscaDmaTransferFunc(const iocshArgBuf *args)
+{
+    int source, dest, swap;
+    size_t source_addr, dest_addr, size;
+
+    if (!args[0].sval || !args[1].sval)
+    {
+        iocshCmd("help toscaDmaTransfer");
+        printf("addrspaces: USER[1|2], SMEM[1|2], A32, BLT, MBLT, 2eVME, 2eVMEFast, 2eSST(160|267|320)\n");
+        return;
+    }
+    if (toscaDmaParseArgs(args, &source, &source_addr, &dest, &dest_addr, &size, &swap) != 0)
+        return;
 
     errno = 0;
     toscaDmaTransfer(source, source_addr, dest, dest_addr, size, swap, args[4].ival, NULL, NULL);
     printf("%m\n");
 }
 
+static void toscaIntrDmaCallback(void* user, int status)
+{
+    if (status) fprintf(stderr, "%s: %s\n", (char*)user, strerror(status));
+}
+
+static const iocshFuncDef toscaIntrConnectDmaDef =
+    { "toscaIntrConnectDma", 5, (const iocshArg *[]) {
+    &(iocshArg) { "[addrspace:]sourceaddr", iocshArgString },
+    &(iocshArg) { "[addrspace:]destaddr", iocshArgString },
+    &(iocshArg) { "size", iocshArgString },
+    &(iocshArg) { "swap(WS|DS|QS)", iocshArgString },
+    &(iocshArg) { "intmask", iocshArgString },
+}};
+
+static void toscaIntrConnectDmaFunc(const iocshArgBuf *args)
+{
+    int source, dest, swap;
+    size_t source_addr, dest_addr, size;
+    intrmask_t mask;
+    struct dmaRequest* r;
+    char* name;
+
+    if (!args[0].sval || !args[1].sval || !args[4].sval)
+    {
+        iocshCmd("help toscaIntrConnectDma");
+        printf("addrspaces: USER[1|2], SMEM[1|2], A32, BLT, MBLT, 2eVME, 2eVMEFast, 2eSST(160|267|320)\n");
+        printf(maskhelp);
+        return;
+    }
+    if (toscaDmaParseArgs(args, &source, &source_addr, &dest, &dest_addr, &size, &swap) != 0)
+        return;
+    mask = toscaStrToIntrMask(args[4].sval);
+    if (!mask)
+    {
+        fprintf(stderr, "Invalid mask \"%s\"\n" , args[4].sval);
+        fprintf(stderr, maskhelp);
+        return;
+    }
+    name = strdup(args[4].sval);
+    r = toscaDmaSetup(source, source_addr, dest, dest_addr, size, swap, 0,
+        toscaIntrDmaCallback, name);
+    if (!r)
+    {
+        fprintf(stderr, "%m\n");
+        free(name);
+        return;
+    }
+    if (toscaIntrConnectDma(mask, r) != 0)
+    {
+        fprintf(stderr, "%m\n");
+        toscaDmaRelease(r);
+        free(name);
+    }
+}
+
 static const iocshFuncDef toscaStrToDmaSpaceDef =
     { "toscaStrToDmaSpace", 1, (const iocshArg *[]) {
     &(iocshArg) { "addrspace[:address]", iocshArgString },
@@ -858,10 +1215,19 @@ static void toscaIocshRegistrar(void)
     iocshRegister(&toscaListDevicesDef, toscaListDevicesFunc);
     iocshRegister(&toscaDeviceTypeDef, toscaDeviceTypeFunc);
     iocshRegister(&toscaMapDef, toscaMapFunc);
+    iocshRegister(&toscaUnmapDef, toscaUnmapFunc);
+    iocshRegister(&toscaMapPlanDef, toscaMapPlanFunc);
+    iocshRegister(&toscaMapPrefaultDef, toscaMapPrefaultFunc);
     iocshRegister(&toscaMapLookupAddrDef, toscaMapLookupAddrFunc);
     iocshRegister(&toscaMapShowDef, toscaMapShowFunc);
     iocshRegister(&toscaMapFindDef, toscaMapFindFunc);
+    iocshRegister(&toscaSlavePoolConfigureDef, toscaSlavePoolConfigureFunc);
+    iocshRegister(&toscaSlaveWindowCreateDef, toscaSlaveWindowCreateFunc);
+    iocshRegister(&toscaSlavePoolShowDef, toscaSlavePoolShowFunc);
     iocshRegister(&toscaGetVmeErrDef, toscaGetVmeErrFunc);
+    iocshRegister(&toscaVmeErrMonitorStartDef, toscaVmeErrMonitorStartFunc);
+    iocshRegister(&toscaVmeErrShowDef, toscaVmeErrShowFunc);
+    iocshRegister(&toscaVmeScanDef, toscaVmeScanFunc);
     iocshRegister(&toscaReadDef, toscaReadFunc);
     iocshRegister(&toscaWriteDef, toscaWriteFunc);
     iocshRegister(&toscaSetDef, toscaSetFunc);
@@ -883,9 +1249,11 @@ static void toscaIocshRegistrar(void)
     iocshRegister(&toscaIntrDisconnectHandlerDef, toscaIntrDisconnectHandlerFunc);
     iocshRegister(&toscaIntrEnableDef, toscaIntrEnableFunc);
     iocshRegister(&toscaIntrDisableDef, toscaIntrDisableFunc);
+    iocshRegister(&toscaIntrWaitDef, toscaIntrWaitFunc);
     iocshRegister(&toscaSendVMEIntrDef, toscaSendVMEIntrFunc);
     iocshRegister(&toscaInstallSpuriousVMEInterruptHandlerDef, toscaInstallSpuriousVMEInterruptHandlerFunc);
     iocshRegister(&toscaDmaTransferDef, toscaDmaTransferFunc);
+    iocshRegister(&toscaIntrConnectDmaDef, toscaIntrConnectDmaFunc);
     iocshRegister(&toscaStrToDmaSpaceDef, toscaStrToDmaSpaceFunc);
     iocshRegister(&toscaDmaSpaceToStrDef, toscaDmaSpaceToStrFunc);
     iocshRegister(&toscaStrToAddrDef, toscaStrToAddrFunc);
@@ -895,7 +1263,15 @@ static void toscaIocshRegistrar(void)
 epicsExportRegistrar(toscaIocshRegistrar);
 
 epicsExportAddress(int, toscaMapDebug);
+epicsExportAddress(int, toscaMapEvict);
+epicsExportAddress(int, toscaMapCoalesce);
+epicsExportAddress(int, toscaMapPopulate);
+epicsExportAddress(int, toscaMapAlign);
 epicsExportAddress(int, toscaIntrDebug);
 epicsExportAddress(int, toscaDmaDebug);
 epicsExportAddress(int, toscaRegDebug);
+epicsExportAddress(int, toscaCopyDebug);
+epicsExportAddress(int, toscaCopyMaxWidth);
+epicsExportAddress(int, toscaCopyReadLines);
+epicsExportAddress(int, toscaSlaveDebug);
 
@@ -2,6 +2,7 @@
 #include <errno.h>
 
 #include <epicsTypes.h>
+#include <dbScan.h>
 
 #include <regDev.h>
 
@@ -17,12 +18,35 @@
 
 struct regDevice
 {
-    int dummy;
+    double period;
+    IOSCANPVT ioscanpvt;
 };
 
-void toscaPonDevReport(regDevice *device __attribute__((unused)), int level __attribute__((unused)))
+void toscaPonDevReport(regDevice *device, int level __attribute__((unused)))
 {
-    printf("Tosca PON\n");
+    printf("Tosca PON");
+    if (device->period > 0)
+        printf(", sampled every %g s, %llu samples", device->period, toscaPonSamplerUpdates());
+    printf("\n");
+}
+
+static void toscaPonDevChanged(void* usr, unsigned int changed)
+{
+    debugLvl(2, "PON registers changed: 0x%x", changed);
+    scanIoRequest(((regDevice*)usr)->ioscanpvt);
+}
+
+static IOSCANPVT toscaPonDevGetIoScanPvt(
+    regDevice *device,
+    size_t offset __attribute__((unused)),
+    unsigned int dlen __attribute__((unused)),
+    size_t nelm __attribute__((unused)),
+    int ivec __attribute__((unused)),
+    const char* user)
+{
+    if (!device->ioscanpvt)
+        error("%s %s: I/O Intr needs a sampling period", user, regDevName(device));
+    return device->ioscanpvt;
 }
 
 int toscaPonDevRead(
@@ -50,7 +74,8 @@ int toscaPonDevRead(
     }
     for (i = 0; i < nelem; i++)
     {
-        ((epicsUInt32*)pdata)[i] = toscaPonRead(offset+(i<<2));
+        ((epicsUInt32*)pdata)[i] = device->period > 0 ?
+            toscaPonReadCached(offset+(i<<2)) : toscaPonRead(offset+(i<<2));
     }
     return 0;
 }
@@ -98,18 +123,19 @@ struct regDevSupport toscaPonDevRegDev = {
     .report = toscaPonDevReport,
     .read = toscaPonDevRead,
     .write = toscaPonDevWrite,
+    .getInScanPvt = toscaPonDevGetIoScanPvt,
 };
 
-int toscaPonDevConfigure(const char* name)
+int toscaPonDevConfigure(const char* name, double period)
 {
     regDevice *device = NULL;
 
     if (!name || !name[0])
     {
-        printf("usage: toscaPonDevConfigure name\n");
+        printf("usage: toscaPonDevConfigure name [sample_period_sec]\n");
         return -1;
     }
-    device = malloc(sizeof(regDevice));
+    device = calloc(1, sizeof(regDevice));
     if (!device)
     {
         fprintf(stderr, "malloc regDevice failed: %m\n");
@@ -122,6 +148,16 @@ int toscaPonDevConfigure(const char* name)
         free(device);
         return -1;
     }
+    if (period > 0)
+    {
+        device->period = period;
+        scanIoInit(&device->ioscanpvt);
+        if (toscaPonSamplerStart(period, toscaPonDevChanged, device) != 0)
+        {
+            fprintf(stderr, "toscaPonSamplerStart() failed: %m\n");
+            return -1;
+        }
+    }
     if (regDevInstallWorkQueue(device, 100) != SUCCESS)
     {
         fprintf(stderr, "regDevInstallWorkQueue() failed: %m\n");
@@ -131,13 +167,25 @@ int toscaPonDevConfigure(const char* name)
 }
 
 static const iocshFuncDef toscaPonDevConfigureDef =
-    { "toscaPonDevConfigure", 1, (const iocshArg *[]) {
+    { "toscaPonDevConfigure", 2, (const iocshArg *[]) {
     &(iocshArg) { "name", iocshArgString },
+    &(iocshArg) { "sample_period_sec", iocshArgDouble },
 }};
 
 static void toscaPonDevConfigureFunc(const iocshArgBuf *args)
 {
-    toscaPonDevConfigure(args[0].sval);
+    toscaPonDevConfigure(args[0].sval, args[1].dval);
+}
+
+static const iocshFuncDef toscaPonSamplerStartDef =
+    { "toscaPonSamplerStart", 1, (const iocshArg *[]) {
+    &(iocshArg) { "period_sec", iocshArgDouble },
+}};
+
+static void toscaPonSamplerStartFunc(const iocshArgBuf *args)
+{
+    if (toscaPonSamplerStart(args[0].dval, NULL, NULL) != 0)
+        fprintf(stderr, "%m\n");
 }
 
 static const iocshFuncDef toscaPonReadDef =
@@ -232,6 +280,7 @@ static void toscaPonRegistrar(void)
     iocshRegister(&toscaPonWriteMaskedDef, toscaPonWriteMaskedFunc);
     iocshRegister(&toscaPonSetDef, toscaPonSetFunc);
     iocshRegister(&toscaPonClearDef, toscaPonClearFunc);
+    iocshRegister(&toscaPonSamplerStartDef, toscaPonSamplerStartFunc);
 }
 
 epicsExportRegistrar(toscaPonRegistrar);
@@ -1,9 +1,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 #include <epicsExit.h>
 #include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsEvent.h>
 #include <ellLib.h>
 #include <dbAccess.h>
 #include <iocsh.h>
@@ -15,6 +18,7 @@
 #include "toscaMap.h"
 #include "toscaDma.h"
 #include "toscaIntr.h"
+#include "toscaCopy.h"
 
 typedef uint8_t __u8;
 typedef uint32_t __u32;
@@ -42,8 +46,48 @@ struct regDevice
     unsigned int addrspace;
     unsigned int dmaSpace;
     unsigned int swap;
+    unsigned int pioWidth;
     int ivec;
     IOSCANPVT ioscanpvt[256];
+    char* snapshot; /* pingpong snapshot or read cache */
+    size_t snapshotSize;
+    int snapshotDma;
+    epicsMutexId snapshotLock;
+    int pingpong;
+    unsigned long pingpongCount;
+    int cacheValid;
+    unsigned int cacheTime;
+    struct timespec cacheStamp;
+    unsigned long cacheHits;
+    unsigned long cacheMisses;
+    char* shadow; /* write combining */
+    size_t dirtyStart;
+    size_t dirtyEnd;
+    epicsMutexId shadowLock;
+    unsigned int combineTime;
+    unsigned long combinedWrites;
+    unsigned long flushes;
+    struct toscaRegDevIntrEvent* intrQueue; /* NULL: process I/O Intr in interrupt thread */
+    volatile unsigned int intrHead;         /* written by interrupt thread only */
+    volatile unsigned int intrTail;         /* written by worker thread only */
+    epicsEventId intrEvent;
+    int intrThreadPrio;
+    unsigned long intrLost;
+    unsigned long intrCount;                /* statistics written by processing thread only */
+    double latencySum;
+    double latencyMax;
+    double busySum;
+    double busyMax;
+    unsigned int convertLen;                /* raw integer size for conversion to double, 0: no conversion */
+    int convertSigned;
+    double convertScale;
+    double convertOffset;
+    epicsMutexId convertLock;
+    char* convertBuffer[2];
+    struct toscaRegDevChunk {
+        epicsEventId done;
+        int status;
+    } convertChunk[2];
 };
 
 #define VME_DMA_MODES (VME_BLT|VME_MBLT|VME_2eVME|VME_2eSST160|VME_2eSST267|VME_2eSST320)
@@ -60,13 +104,234 @@ void toscaRegDevReport(regDevice *device, int level __attribute__((unused)))
             device->swap == 2 ? "WS" : device->swap == 4 ? "DS" : device->swap == 8 ? "QS" : "??");
     if (!device->baseptr)
         printf(", DMA only");
+    if (device->baseptr && device->pioWidth)
+        printf(", PIO read width=%u", device->pioWidth);
     if (!device->dmaSpace)
         printf(", no DMA");
     if (device->dmaReadLimit > 1 || device->dmaWriteLimit > 1)
         printf(", DMA R/W limit=%u/%u", device->dmaReadLimit, device->dmaWriteLimit);
+    if (device->pingpong)
+        printf(", pingpong 2x0x%zx, %lu flips", device->snapshotSize, device->pingpongCount);
+    else if (device->snapshot)
+        printf(", cache %u ms, %lu hits, %lu misses", device->cacheTime, device->cacheHits, device->cacheMisses);
+    if (device->shadow)
+        printf(", combine %u ms, %lu writes in %lu flushes", device->combineTime, device->combinedWrites, device->flushes);
+    if (device->convertLen)
+        printf(", convert %sINT%u*%g%+g", device->convertSigned ? "" : "U", device->convertLen * 8,
+            device->convertScale, device->convertOffset);
+    if (device->intrQueue || device->intrCount)
+    {
+        printf(", I/O Intr %s: %lu scans", device->intrQueue ? "thread" : "inline", device->intrCount);
+        if (device->intrCount)
+            printf(" latency avg %.0f max %.0f us, busy avg %.0f max %.0f us",
+                device->latencySum / device->intrCount * 1e6, device->latencyMax * 1e6,
+                device->busySum / device->intrCount * 1e6, device->busyMax * 1e6);
+        if (device->intrLost)
+            printf(", %lu lost", device->intrLost);
+    }
     printf("\n");
 }
 
+/* Fill the snapshot from offset with DMA if possible or with wide reads.
+   Call with snapshotLock held. */
+static int toscaRegDevFillSnapshot(regDevice *device, size_t offset)
+{
+    if (device->snapshotDma)
+    {
+        if (toscaDmaRead(device->dmaSpace, device->baseaddr + offset, device->snapshot, device->snapshotSize,
+            device->swap, 0, NULL, NULL) != 0)
+        {
+            debugErrno("toscaDmaRead %s %s:0x%zx[0x%zx]", device->name,
+                toscaDmaSpaceToStr(device->dmaSpace), device->baseaddr + offset, device->snapshotSize);
+            return -1;
+        }
+        return SUCCESS;
+    }
+    toscaCopyRead(device->snapshot, device->baseptr + offset, device->snapshotSize,
+        device->pioWidth ? device->pioWidth : device->swap ? device->swap : 1);
+    if (device->swap)
+        toscaCopySwap(device->snapshot, device->snapshot, device->snapshotSize / device->swap, device->swap);
+    return SUCCESS;
+}
+
+static void toscaRegDevCacheInvalidate(regDevice *device)
+{
+    epicsMutexMustLock(device->snapshotLock);
+    device->cacheValid = 0;
+    epicsMutexUnlock(device->snapshotLock);
+}
+
+struct toscaRegDevWriteDone {
+    regDevice *device;
+    regDevTransferComplete callback;
+    const char* user;
+};
+
+static void toscaRegDevWriteComplete(struct toscaRegDevWriteDone* done, int status)
+{
+    regDevTransferComplete callback = done->callback;
+    const char* user = done->user;
+
+    toscaRegDevCacheInvalidate(done->device);
+    free(done);
+    callback(user, status);
+}
+
+/* Write the dirty range of the shadow buffer to the device
+   with one DMA or one PIO burst. Call with shadowLock held. */
+static int toscaRegDevFlushShadow(regDevice *device)
+{
+    size_t start = device->dirtyStart;
+    size_t len = device->dirtyEnd - device->dirtyStart;
+    unsigned int elemsize = device->swap ? device->swap : 1;
+    int status = SUCCESS;
+
+    if (!len) return SUCCESS;
+    debugLvl(2, "%s: flush 0x%zx[0x%zx]", device->name, start, len);
+    device->flushes++;
+    /* DMA needs multiples of 8 bytes at 8 byte aligned addresses and at most 16M */
+    if (device->dmaWriteLimit && len / elemsize >= device->dmaWriteLimit &&
+        !((device->baseaddr + start) & 7) && !(len & 7) && len <= 0x1000000)
+    {
+        status = toscaDmaWrite(device->shadow + start, device->dmaSpace, device->baseaddr + start, len,
+            device->swap, 0, NULL, NULL);
+        if (status != 0)
+            debugErrno("toscaDmaWrite %s %s:0x%zx[0x%zx], using memory map", device->name,
+                toscaDmaSpaceToStr(device->dmaSpace), device->baseaddr + start, len);
+    }
+    else
+        status = -1;
+    if (status != 0)
+    {
+        /* combine requires a memory map, so this always works */
+        toscaCopySwapWidth(device->baseptr + start, device->shadow + start, len / elemsize, elemsize,
+            toscaCopySwapMaxWidth(device->addrspace));
+        status = SUCCESS;
+    }
+    device->dirtyStart = device->dirtyEnd = 0;
+    if (device->snapshot)
+        toscaRegDevCacheInvalidate(device);
+    return status;
+}
+
+int toscaRegDevFlush(const char* name)
+{
+    regDevice *device = regDevFind(name);
+    int status;
+
+    if (!device || device->magic != TOSCA_MAGIC)
+    {
+        error("%s is not a Tosca regDev device", name);
+        errno = ENODEV;
+        return -1;
+    }
+    if (!device->shadow) return SUCCESS;
+    epicsMutexMustLock(device->shadowLock);
+    status = toscaRegDevFlushShadow(device);
+    epicsMutexUnlock(device->shadowLock);
+    return status;
+}
+
+static void toscaRegDevFlushThread(void* arg)
+{
+    regDevice *device = arg;
+
+    while (1)
+    {
+        epicsThreadSleep(device->combineTime * 1e-3);
+        epicsMutexMustLock(device->shadowLock);
+        toscaRegDevFlushShadow(device);
+        epicsMutexUnlock(device->shadowLock);
+    }
+}
+
+static void toscaRegDevFlushAtExit(void* arg)
+{
+    regDevice *device = arg;
+
+    epicsMutexMustLock(device->shadowLock);
+    toscaRegDevFlushShadow(device);
+    epicsMutexUnlock(device->shadowLock);
+}
+
+/* Conversion of raw integers to double: Transfer segments of
+   TOSCA_REGDEV_CONVERT_CHUNK bytes into two alternating buffers.
+   While one segment is converted, the DMA worker threads already
+   transfer the next one. */
+#define TOSCA_REGDEV_CONVERT_CHUNK 0x10000
+
+static void toscaRegDevChunkDone(struct toscaRegDevChunk* chunk, int status)
+{
+    chunk->status = status;
+    epicsEventSignal(chunk->done);
+}
+
+static int toscaRegDevReadConvert(regDevice *device, size_t offset, size_t nelem, double* pdata, const char* user)
+{
+    unsigned int len = device->convertLen;
+    size_t rawoffset = offset / 8 * len;
+    size_t chunkelem = TOSCA_REGDEV_CONVERT_CHUNK / len;
+    size_t n, done = 0;
+    int dma = device->dmaSpace && device->dmaReadLimit && nelem >= device->dmaReadLimit;
+    int async = dma && toscaDmaLoopsRunning() > 0;
+    int status = SUCCESS;
+    int k = 0;
+
+    if (offset % 8)
+    {
+        error("%s: offset 0x%zx must be a multiple of 8 on converting device %s", user, offset, device->name);
+        return -1;
+    }
+    epicsMutexMustLock(device->convertLock);
+    if (async)
+    {
+        n = nelem < chunkelem ? nelem : chunkelem;
+        status = toscaDmaRead(device->dmaSpace, device->baseaddr + rawoffset, device->convertBuffer[0], n * len,
+            device->swap, 0, (toscaDmaCallback)toscaRegDevChunkDone, &device->convertChunk[0]);
+    }
+    while (status == SUCCESS && done < nelem)
+    {
+        char* buffer = device->convertBuffer[k];
+        n = nelem - done < chunkelem ? nelem - done : chunkelem;
+        if (async)
+        {
+            epicsEventMustWait(device->convertChunk[k].done);
+            status = device->convertChunk[k].status;
+            if (status != SUCCESS) break;
+            if (done + n < nelem)
+            {
+                size_t next = nelem - done - n < chunkelem ? nelem - done - n : chunkelem;
+                status = toscaDmaRead(device->dmaSpace, device->baseaddr + rawoffset + (done + n) * len,
+                    device->convertBuffer[k^1], next * len,
+                    device->swap, 0, (toscaDmaCallback)toscaRegDevChunkDone, &device->convertChunk[k^1]);
+            }
+        }
+        else if (dma)
+            status = toscaDmaRead(device->dmaSpace, device->baseaddr + rawoffset + done * len, buffer, n * len,
+                device->swap, 0, NULL, NULL);
+        else
+        {
+            toscaCopyRead(buffer, device->baseptr + rawoffset + done * len, n * len,
+                device->pioWidth ? device->pioWidth : len);
+            if (device->swap)
+                toscaCopySwap(buffer, buffer, n * len / device->swap, device->swap);
+        }
+        if (status != SUCCESS) break;
+        toscaCopyToDouble(pdata + done, buffer, n, len, device->convertSigned,
+            device->convertScale, device->convertOffset);
+        done += n;
+        k ^= 1;
+    }
+    epicsMutexUnlock(device->convertLock);
+    if (status != SUCCESS)
+    {
+        errno = status;
+        debugErrno("%s: %s convert read 0x%zx[%zu]", user, device->name, offset, nelem);
+        return -1;
+    }
+    return SUCCESS;
+}
+
 int toscaRegDevRead(
     regDevice *device,
     size_t offset,
@@ -86,6 +351,53 @@ int toscaRegDevRead(
         device->name, offset, dlen, nelem, device->dmaReadLimit, user);
     if (!nelem || !dlen) return SUCCESS;
 
+    if (device->convertLen)
+    {
+        if (dlen != 8)
+        {
+            error("%s: %s converts to double, use T=DOUBLE", user, device->name);
+            return -1;
+        }
+        return toscaRegDevReadConvert(device, offset, nelem, pdata, user);
+    }
+
+    if (device->shadow && device->dirtyEnd)
+    {
+        /* read after write: flush pending writes first */
+        epicsMutexMustLock(device->shadowLock);
+        toscaRegDevFlushShadow(device);
+        epicsMutexUnlock(device->shadowLock);
+    }
+
+    if (device->snapshot)
+    {
+        /* pingpong: serve all reads from the snapshot of the stable half */
+        /* cache: serve all reads from the cache, refresh when invalid or too old */
+        int status = SUCCESS;
+        epicsMutexMustLock(device->snapshotLock);
+        if (!device->pingpong)
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (!device->cacheValid || (device->cacheTime &&
+                (now.tv_sec - device->cacheStamp.tv_sec) * 1000 +
+                (now.tv_nsec - device->cacheStamp.tv_nsec) / 1000000 >= device->cacheTime))
+            {
+                device->cacheMisses++;
+                debugLvl(2, "%s: cache refresh", user);
+                status = toscaRegDevFillSnapshot(device, 0);
+                device->cacheValid = (status == SUCCESS);
+                device->cacheStamp = now;
+            }
+            else
+                device->cacheHits++;
+        }
+        if (status == SUCCESS)
+            memcpy(pdata, device->snapshot + offset, nelem*dlen);
+        epicsMutexUnlock(device->snapshotLock);
+        return status;
+    }
+
     if (device->dmaReadLimit && nelem >= device->dmaReadLimit)
     {
         char* fname;
@@ -127,10 +439,18 @@ int toscaRegDevRead(
             pdata += misalignment;
         }
         words = (nelem * dlen - misalignment) / device->swap;
-        if (words)
-            regDevCopy(device->swap, words, device->baseptr + offset, pdata, NULL, REGDEV_DO_SWAP);
-
+        if (words > 1 && device->pioWidth)
+        {
+            /* wide reads first, then swap in memory, which is much faster than reading */
+            toscaCopyRead(pdata, device->baseptr + offset, words * device->swap, device->pioWidth);
+            toscaCopySwap(pdata, pdata, words, device->swap);
+        }
+        else if (words)
+            toscaCopySwapWidth(pdata, device->baseptr + offset, words, device->swap,
+                toscaCopySwapMaxWidth(device->addrspace));
     }
+    else if (nelem > 1 && device->pioWidth)
+        toscaCopyRead(pdata, device->baseptr + offset, nelem * dlen, device->pioWidth);
     else
         regDevCopy(dlen, nelem, device->baseptr + offset, pdata, NULL, REGDEV_NO_SWAP);
     return SUCCESS;
@@ -143,7 +463,7 @@ int toscaRegDevWrite(
     size_t nelem,
     void* pdata,
     void* pmask,
-    int priority __attribute__((unused)),
+    int priority,
     regDevTransferComplete callback,
     const char* user)
 {
@@ -156,16 +476,73 @@ int toscaRegDevWrite(
         device->name, offset, dlen, nelem, device->dmaWriteLimit, pmask, user);
     if (!nelem || !dlen) return SUCCESS;
 
+    if (device->pingpong || device->convertLen)
+    {
+        error("%s: %s is a read-only %s device", user, device->name, device->pingpong ? "pingpong" : "converting");
+        return -1;
+    }
+    if (device->snapshot)
+        toscaRegDevCacheInvalidate(device);
+
+    if (device->shadow)
+    {
+        size_t start = offset, end = offset + nelem*dlen;
+        int combine = !pmask && !(device->swap && (start | end) % device->swap);
+        int status = SUCCESS;
+
+        epicsMutexMustLock(device->shadowLock);
+        /* Keep the order: flush before masked or unaligned writes and
+           before a write that would make the dirty range non-contiguous. */
+        if (!combine || (device->dirtyEnd && (start > device->dirtyEnd || end < device->dirtyStart)))
+            status = toscaRegDevFlushShadow(device);
+        if (combine)
+        {
+            memcpy(device->shadow + start, pdata, nelem*dlen);
+            if (!device->dirtyEnd || start < device->dirtyStart) device->dirtyStart = start;
+            if (end > device->dirtyEnd) device->dirtyEnd = end;
+            device->combinedWrites++;
+            if (priority >= 2) /* PRIO=HIGH: flush record */
+                status = toscaRegDevFlushShadow(device);
+            epicsMutexUnlock(device->shadowLock);
+            return status;
+        }
+        epicsMutexUnlock(device->shadowLock);
+        /* write through */
+    }
+
     if (pmask == NULL && device->dmaWriteLimit && nelem >= device->dmaWriteLimit)
     {
         char* fname;
         void* usr = (void*)user;
 
         assert(device->dmaSpace != 0);
+        if (callback != NULL && device->snapshot)
+        {
+            /* invalidate the cache again when the DMA has completed */
+            struct toscaRegDevWriteDone* done = malloc(sizeof(struct toscaRegDevWriteDone));
+            if (done)
+            {
+                done->device = device;
+                done->callback = callback;
+                done->user = user;
+                usr = done;
+                callback = (regDevTransferComplete)toscaRegDevWriteComplete;
+            }
+            else
+                callback = NULL; /* wait for completion */
+        }
         int status = toscaDmaWrite(pdata, device->dmaSpace, device->baseaddr + offset, nelem*dlen,
             device->swap, 0, (toscaDmaCallback)callback, usr);
         if (callback != NULL && status == 0)
             return ASYNC_COMPLETION;
+        if (usr != (void*)user)
+        {
+            /* DMA not started */
+            callback = ((struct toscaRegDevWriteDone*)usr)->callback;
+            free(usr);
+        }
+        if (device->snapshot)
+            toscaRegDevCacheInvalidate(device);
         if (status != 0) debugErrno("toscaDmaWrite %s %s:0x%zx %s:0x%zx[0x%zx] swap=%d callback=%s(%p)",
             user, device->name, offset, toscaDmaSpaceToStr(device->dmaSpace), device->baseaddr + offset, nelem*dlen,
             device->swap, fname=symbolName(callback,0), user), free(fname);
@@ -188,10 +565,15 @@ int toscaRegDevWrite(
     }
     assert(device->baseptr != NULL);
     assert(pdata != NULL);
-    if (device->swap)
+    if (device->swap && !pmask)
+        toscaCopySwapWidth(device->baseptr + offset, pdata, nelem*dlen/device->swap, device->swap,
+            toscaCopySwapMaxWidth(device->addrspace));
+    else if (device->swap)
         regDevCopy(device->swap, nelem*dlen/device->swap, pdata, device->baseptr + offset, pmask, REGDEV_DO_SWAP);
     else
         regDevCopy(dlen, nelem, pdata, device->baseptr + offset, pmask, device->swap ? REGDEV_DO_SWAP : REGDEV_NO_SWAP);
+    if (device->snapshot)
+        toscaRegDevCacheInvalidate(device); /* a refresh may have overlapped with the write */
     return SUCCESS;
 };
 
@@ -247,6 +629,131 @@ void toscaScanIoRequest(IOSCANPVT piosh)
     }
 }
 
+/* Interrupts of a device are processed either directly in the interrupt
+   thread (fast but a slow record chain blocks all other interrupts)
+   or with the intrthread flag in a worker thread per device.
+   Latency (interrupt to start of processing) and busy time are measured
+   in both cases to help choosing.
+
+   A pingpong device consists of two halves which the hardware fills
+   alternately and signals each completed half with its own interrupt:
+   the even vector (or USER line) for the first half, the next odd one
+   for the second half. Thus a missed interrupt cannot mix up the halves.
+   Before processing the I/O Intr records, the completed (now stable)
+   half is copied into a snapshot, so all records of one scan read the
+   same data with one transfer. This happens in the thread processing
+   the records, so a snapshot never changes under the records of the
+   previous scan still running in the worker thread.
+   A cached device invalidates the cache on each interrupt instead,
+   so that the first record of the scan refreshes it.
+   A write combining device flushes after the records of the scan.
+*/
+struct toscaRegDevIntr {
+    regDevice *device;
+    IOSCANPVT ioscanpvt;
+};
+
+#define TOSCA_REGDEV_INTR_QUEUE_SIZE 64 /* power of 2 */
+
+struct toscaRegDevIntrEvent {
+    struct toscaRegDevIntr* di;
+    struct timespec stamp;
+    int half;
+};
+
+static double toscaRegDevElapsed(const struct timespec* t0, const struct timespec* t1)
+{
+    return (t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static void toscaRegDevProcessIntr(struct toscaRegDevIntr* di, const struct timespec* stamp, int half)
+{
+    regDevice *device = di->device;
+    struct timespec start, end;
+    double latency, busy;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    /* in the processing thread, so the records of the previous scan are done */
+    if (device->snapshot)
+        epicsMutexMustLock(device->snapshotLock);
+    if (device->pingpong)
+    {
+        device->pingpongCount++;
+        debugLvl(2, "%s: snapshot of half %d", device->name, half);
+        toscaRegDevFillSnapshot(device, half * device->snapshotSize);
+    }
+    else if (device->snapshot)
+        device->cacheValid = 0;
+    if (device->snapshot)
+        epicsMutexUnlock(device->snapshotLock);
+    toscaScanIoRequest(di->ioscanpvt);
+    if (device->shadow)
+    {
+        /* end of scan: write what the records have combined */
+        epicsMutexMustLock(device->shadowLock);
+        toscaRegDevFlushShadow(device);
+        epicsMutexUnlock(device->shadowLock);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    latency = toscaRegDevElapsed(stamp, &start);
+    busy = toscaRegDevElapsed(&start, &end);
+    device->intrCount++;
+    device->latencySum += latency;
+    if (latency > device->latencyMax) device->latencyMax = latency;
+    device->busySum += busy;
+    if (busy > device->busyMax) device->busyMax = busy;
+}
+
+static void toscaRegDevIntrThread(void* arg)
+{
+    regDevice *device = arg;
+    struct toscaRegDevIntrEvent event;
+    unsigned int tail;
+
+    while (1)
+    {
+        tail = device->intrTail;
+        while (device->intrHead == tail)
+            epicsEventMustWait(device->intrEvent);
+        __sync_synchronize();
+        event = device->intrQueue[tail & (TOSCA_REGDEV_INTR_QUEUE_SIZE-1)];
+        __sync_synchronize();
+        device->intrTail = tail + 1;
+        toscaRegDevProcessIntr(event.di, &event.stamp, event.half);
+    }
+}
+
+static void toscaRegDevIntrHandler(struct toscaRegDevIntr* di, int inum, int ivec)
+{
+    regDevice *device = di->device;
+    struct timespec stamp;
+    /* the odd vector or line signals the second pingpong half */
+    int half = (device->addrspace & (VME_A16|VME_A24|VME_A32|VME_A64) ? ivec : inum) & 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &stamp);
+    if (device->intrQueue)
+    {
+        unsigned int head = device->intrHead;
+        struct toscaRegDevIntrEvent* event;
+
+        if (head - device->intrTail >= TOSCA_REGDEV_INTR_QUEUE_SIZE)
+        {
+            debugLvl(2, "%s: interrupt queue full", device->name);
+            device->intrLost++;
+            return;
+        }
+        event = &device->intrQueue[head & (TOSCA_REGDEV_INTR_QUEUE_SIZE-1)];
+        event->di = di;
+        event->stamp = stamp;
+        event->half = half;
+        __sync_synchronize();
+        device->intrHead = head + 1;
+        epicsEventSignal(device->intrEvent);
+    }
+    else
+        toscaRegDevProcessIntr(di, &stamp, half);
+}
+
 static IOSCANPVT toscaRegDevGetIoScanPvt(
     regDevice *device,
     size_t offset __attribute__((unused)),
@@ -294,16 +801,58 @@ static IOSCANPVT toscaRegDevGetIoScanPvt(
         return NULL;
     }
 
+    if (device->pingpong)
+    {
+        /* the pair of even and odd interrupt shares one scan */
+        ivec &= ~1;
+    }
+
     if (device->ioscanpvt[ivec] == NULL)
     {
+        struct toscaRegDevIntr* di;
+        intrmask_t intrmask = device->addrspace & (VME_A16|VME_A24|VME_A32|VME_A64) ?
+            TOSCA_VME_INTR_ANY_VEC(ivec) : TOSCA_USER1_INTR(ivec);
+        intrmask_t intrmask2 = device->addrspace & (VME_A16|VME_A24|VME_A32|VME_A64) ?
+            TOSCA_VME_INTR_ANY_VEC(ivec+1) : TOSCA_USER1_INTR(ivec+1);
+
         debug("%s: init %s interrupt %d handling", user, toscaAddrSpaceToStr(device->addrspace), ivec);
+        di = malloc(sizeof(struct toscaRegDevIntr));
+        if (!di)
+        {
+            error("%s: out of memory", user);
+            return NULL;
+        }
         scanIoInit(&device->ioscanpvt[ivec]);
+        di->device = device;
+        di->ioscanpvt = device->ioscanpvt[ivec];
+
+        if (device->intrThreadPrio && !device->intrQueue)
+        {
+            char threadname[20];
+            device->intrQueue = calloc(TOSCA_REGDEV_INTR_QUEUE_SIZE, sizeof(struct toscaRegDevIntrEvent));
+            device->intrEvent = epicsEventMustCreate(epicsEventEmpty);
+            sprintf(threadname, "i%.16s", device->name);
+            if (!device->intrQueue || !epicsThreadCreate(threadname, device->intrThreadPrio,
+                epicsThreadGetStackSize(epicsThreadStackBig), toscaRegDevIntrThread, device))
+            {
+                error("%s: cannot start interrupt thread for %s, processing in interrupt thread", user, device->name);
+                free(device->intrQueue);
+                device->intrQueue = NULL;
+            }
+        }
 
-        if (toscaIntrConnectHandler(
-            device->addrspace & (VME_A16|VME_A24|VME_A32|VME_A64) ? TOSCA_VME_INTR_ANY_VEC(ivec) : TOSCA_USER1_INTR(ivec),
-            toscaScanIoRequest, device->ioscanpvt[ivec]) != 0)
+        if (toscaIntrConnectHandler(intrmask, toscaRegDevIntrHandler, di) != 0 ||
+            (device->pingpong && toscaIntrConnectHandler(intrmask2, toscaRegDevIntrHandler, di) != 0))
         {
             unsigned int intraddrspace = device->addrspace;
+            int e = errno;
+            if (device->pingpong && toscaIntrDisconnectHandler(intrmask, toscaRegDevIntrHandler, di) > 0)
+            {
+                /* the second interrupt of the pair failed */
+                toscaIntrDispatchWait();
+                ivec++;
+            }
+            errno = e;
             if (intraddrspace & (TOSCA_USER1|TOSCA_USER2|TOSCA_SMEM))
             {
                 intraddrspace = ivec & 16 ? TOSCA_USER2 : TOSCA_USER1;
@@ -319,6 +868,7 @@ static IOSCANPVT toscaRegDevGetIoScanPvt(
                 error("%s: Cannot connect to %s interrupt %d: %m",
                     user, toscaAddrSpaceToStr(intraddrspace), ivec);
             }
+            free(di);
             return NULL;
         }
     }
@@ -334,6 +884,15 @@ void* toscaRegDevDmaAlloc(regDevice *device __attribute__((unused)), void* ptr,
     return NULL;
 }
 
+/* Record array buffers are the DMA destination, keep them pinned for their lifetime. */
+void* toscaRegDevDmaAllocPinned(regDevice *device __attribute__((unused)), void* ptr, size_t size)
+{
+    /* the initial buffer may come from regDev's calloc */
+    if (toscaDmaFree(ptr) != 0)
+        free(ptr);
+    return toscaDmaAlloc(size);
+}
+
 struct regDevSupport toscaRegDev = {
     .report = toscaRegDevReport,
     .read = toscaRegDevRead,
@@ -346,6 +905,10 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
 {
     regDevice* device;
     int blockmode = 0;
+    int pingpong = 0;
+    int cache = 0;
+    int combine = 0;
+    int pinned = 0;
 
     debug("toscaRegDevConfigure(name=%s, addrspace=0x%x(%s), address=0x%zx size=0x%zx, flags=\"%s\")",
         name, addrspace, toscaAddrSpaceToStr(addrspace), address, size, flags);
@@ -372,6 +935,10 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
     if (addrspace & (TOSCA_USER1|TOSCA_USER2|TOSCA_CSR|TOSCA_IO)) device->swap = 4;
     if (addrspace & (TOSCA_USER1|TOSCA_USER2|TOSCA_SMEM)) device->dmaSpace = addrspace;
     if (addrspace & VME_A32) device->dmaSpace  = VME_SCT;
+    /* wide reads by default only on memory, registers may have read side effects
+       and VME slaves may support only some data widths (e.g. D16) */
+    if ((addrspace & TOSCA_SMEM2) == TOSCA_SMEM2 || addrspace & (TOSCA_SMEM1|TOSCA_SRAM))
+        device->pioWidth = toscaCopyReadWidth(addrspace);
 
     if (flags)
     {
@@ -423,6 +990,42 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
             if (strncasecmp(p, "2eSST320", l) == 0)  { device->dmaSpace = VME_2eSST320; continue; }
             if (strncasecmp(p, "2eSST", l) == 0)     { device->dmaSpace = VME_2eSST320; continue; }
 
+            if (strncasecmp(p, "pingpong", l) == 0)  { pingpong = 1; continue; }
+            if (strncasecmp(p, "pinned", l) == 0)    { pinned = 1; continue; }
+            if (strncasecmp(p, "convert=", 8) == 0)
+            {
+                char* end;
+                const char* t = p+8;
+                device->convertSigned = 1;
+                if (toupper(*t) == 'U') { device->convertSigned = 0; t++; }
+                if (strncasecmp(t, "INT", 3) != 0)
+                    device->convertLen = 0;
+                else switch (strtol(t+3, &end, 10))
+                {
+                    case 8:  device->convertLen = 1; break;
+                    case 16: device->convertLen = 2; break;
+                    case 32: device->convertLen = 4; break;
+                    default: device->convertLen = 0;
+                }
+                if (!device->convertLen)
+                {
+                    error("invalid conversion \"%.*s\", use convert=[U]INT(8|16|32)[,scale[,offset]]", (int)l, p);
+                    free(device);
+                    errno = EINVAL;
+                    return -1;
+                }
+                device->convertScale = *end == ',' ? strtod(end+1, &end) : 1.0;
+                device->convertOffset = *end == ',' ? strtod(end+1, &end) : 0.0;
+                continue;
+            }
+
+            if (strncasecmp(p, "intrthread=", 11) == 0) { device->intrThreadPrio = strtol(p+11, NULL, 0); continue; }
+            if (strncasecmp(p, "intrthread", l) == 0)    { device->intrThreadPrio = epicsThreadPriorityHigh; continue; }
+            if (strncasecmp(p, "combine=", 8) == 0)  { combine = 1; device->combineTime = strtol(p+8, NULL, 0); continue; }
+            if (strncasecmp(p, "cache=", 6) == 0)    { cache = 1; device->cacheTime = strtol(p+6, NULL, 0); continue; }
+
+            if (strncasecmp(p, "pioWidth=", 9) == 0) { device->pioWidth = strtol(p+9, NULL, 0); continue; }
+
             if (strncasecmp(p, "intr=", 5) == 0) { device->ivec = strtol(p+5, NULL, 0); continue; } /* Better use V= in record */
         }
     }
@@ -445,6 +1048,14 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
         debug("block write: dma only");
     }
 
+    if (device->pioWidth & (device->pioWidth - 1) || device->pioWidth > 32)
+    {
+        error("pioWidth=%u must be 0 (element wise), 1, 2, 4, 8, 16 or 32", device->pioWidth);
+        free(device);
+        errno = EINVAL;
+        return -1;
+    }
+
     if (device->dmaReadLimit != 1 || device->dmaWriteLimit != 1) /* not DMA only */
     {
         if ((device->baseptr = toscaMap(addrspace, address, size, 0)) == NULL)
@@ -466,6 +1077,88 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
         return -1;
     }
 
+    if (pingpong || cache)
+    {
+        device->pingpong = pingpong;
+        device->snapshotSize = pingpong ? size / 2 : size;
+        if (device->swap) device->snapshotSize -= device->snapshotSize % device->swap;
+        if (!device->snapshotSize || blockmode || (pingpong && cache))
+        {
+            error("pingpong or cache need a larger size and cannot be combined with each other or with block mode");
+            free(device);
+            errno = EINVAL;
+            return -1;
+        }
+        /* DMA needs multiples of 8 bytes at 8 byte aligned addresses and at most 16M */
+        device->snapshotDma = device->dmaSpace && device->dmaReadLimit &&
+            !((device->baseaddr | device->snapshotSize) & 7) && device->snapshotSize <= 0x1000000;
+        if (!device->snapshotDma && !device->baseptr)
+        {
+            error("%s size 0x%zx at 0x%zx not suitable for DMA (multiple of 8 up to 16M)",
+                pingpong ? "pingpong half" : "cache", device->snapshotSize, device->baseaddr);
+            free(device);
+            errno = EINVAL;
+            return -1;
+        }
+        if (!device->snapshotDma && device->dmaSpace && device->dmaReadLimit)
+            debug("%s: %s size 0x%zx not suitable for DMA, using memory map", name,
+                pingpong ? "pingpong half" : "cache", device->snapshotSize);
+        device->snapshot = valloc(device->snapshotSize); /* page aligned for DMA */
+        if (!device->snapshot)
+        {
+            error("cannot allocate %s buffer: %m", pingpong ? "pingpong" : "cache");
+            free(device);
+            return -1;
+        }
+        memset(device->snapshot, 0, device->snapshotSize);
+        device->snapshotLock = epicsMutexMustCreate();
+        size = device->snapshotSize;
+    }
+
+    if (device->convertLen)
+    {
+        if (blockmode || pingpong || cache || combine)
+        {
+            error("convert cannot be combined with pingpong, cache, combine or block mode");
+            free(device);
+            errno = EINVAL;
+            return -1;
+        }
+        device->convertBuffer[0] = toscaDmaAlloc(TOSCA_REGDEV_CONVERT_CHUNK);
+        device->convertBuffer[1] = toscaDmaAlloc(TOSCA_REGDEV_CONVERT_CHUNK);
+        if (!device->convertBuffer[0] || !device->convertBuffer[1])
+        {
+            error("cannot allocate conversion buffers: %m");
+            toscaDmaFree(device->convertBuffer[0]);
+            toscaDmaFree(device->convertBuffer[1]);
+            free(device);
+            return -1;
+        }
+        device->convertChunk[0].done = epicsEventMustCreate(epicsEventEmpty);
+        device->convertChunk[1].done = epicsEventMustCreate(epicsEventEmpty);
+        device->convertLock = epicsMutexMustCreate();
+        size = size / device->convertLen * 8;
+    }
+
+    if (combine)
+    {
+        if (!device->baseptr || blockmode || pingpong)
+        {
+            error("combine needs a memory map and cannot be combined with pingpong or block mode");
+            free(device);
+            errno = EINVAL;
+            return -1;
+        }
+        device->shadow = valloc(size); /* page aligned for DMA */
+        if (!device->shadow)
+        {
+            error("cannot allocate write combining buffer: %m");
+            free(device);
+            return -1;
+        }
+        device->shadowLock = epicsMutexMustCreate();
+    }
+
     if (regDevRegisterDevice(name, &toscaRegDev, device, size) != SUCCESS)
     {
         error("regDevRegisterDevice() failed");
@@ -473,7 +1166,15 @@ int toscaRegDevConfigure(const char* name, unsigned int addrspace, size_t addres
         return -1;
     }
 
-    regDevRegisterDmaAlloc(device, toscaRegDevDmaAlloc);
+    if (combine)
+    {
+        if (device->combineTime)
+            epicsThreadCreate(name, epicsThreadPriorityMedium,
+                epicsThreadGetStackSize(epicsThreadStackSmall), toscaRegDevFlushThread, device);
+        epicsAtExit(toscaRegDevFlushAtExit, device);
+    }
+
+    regDevRegisterDmaAlloc(device, pinned ? toscaRegDevDmaAllocPinned : toscaRegDevDmaAlloc);
     if (blockmode) regDevMakeBlockdevice(device, blockmode, REGDEV_NO_SWAP, NULL);
 
     return 0;
@@ -510,7 +1211,21 @@ static void toscaRegDevConfigureFunc(const iocshArgBuf *args)
                "           dmaonly (same as 1 both both limits)\n"
                "   - block mode: blockread, blockwrite, block (means both)\n"
                "           (Records with PRIO=HIGH trigger transfer)\n"
+               "           pinned (locked page aligned record buffers for DMA)\n"
                "   - VME block transfer: SCT, BLT, MBLT, 2eVME, 2eSST[160|267|320]\n"
+               "   - PIO read width in bytes: pioWidth=0 (element wise), 1...32\n"
+               "           (Default: 16 for SMEM and SRAM, else 0)\n"
+               "   - pingpong: read-only double buffer of two halves of size/2,\n"
+               "           even/odd interrupt takes a snapshot of first/second half\n"
+               "   - cache=ms: read cache of the whole device, valid for ms\n"
+               "           (0: until next write or interrupt)\n"
+               "   - combine=ms: combine writes, flush after ms, on PRIO=HIGH\n"
+               "           records, after I/O Intr scans or with toscaRegDevFlush\n"
+               "           (0: no periodic flush)\n"
+               "   - intrthread[=prio]: process I/O Intr records in own thread\n"
+               "           (Default: in Tosca interrupt thread)\n"
+               "   - convert=[U]INT(8|16|32)[,scale[,offset]]: read-only device\n"
+               "           converting to double (T=DOUBLE) with pipelined DMA\n"
                "   - VME default interrupt vector: intr=1...255\n"
                "   - USER[1|2] default interrupt line: intr=0...15\n"
                "           (Better use V=... in record link)\n"
@@ -540,9 +1255,26 @@ static void toscaRegDevConfigureFunc(const iocshArgBuf *args)
     }
 }
 
+static const iocshFuncDef toscaRegDevFlushDef =
+    { "toscaRegDevFlush", 1, (const iocshArg *[]) {
+    &(iocshArg) { "name", iocshArgString },
+}};
+
+static void toscaRegDevFlushFunc(const iocshArgBuf *args)
+{
+    if (!args[0].sval)
+    {
+        iocshCmd("help toscaRegDevFlush");
+        return;
+    }
+    if (toscaRegDevFlush(args[0].sval) != 0)
+        fprintf(stderr, "toscaRegDevFlush failed: %m\n");
+}
+
 static void toscaRegDevRegistrar(void)
 {
     iocshRegister(&toscaRegDevConfigureDef, toscaRegDevConfigureFunc);
+    iocshRegister(&toscaRegDevFlushDef, toscaRegDevFlushFunc);
     toscaRegDevDebug = 0;
 }
 
@@ -23,6 +23,9 @@ void toscaSbcDevReport(regDevice *device, int level __attribute__((unused)))
     printf("Tosca Serial Bus to FMC %d 0x%x\n", device->fmc, device->base);
 }
 
+/* Operations are executed in batches, holding the serial bus only once per batch */
+#define SBC_BATCH 64
+
 int toscaSbcDevRead(
     regDevice *device,
     size_t offset,
@@ -33,26 +36,36 @@ int toscaSbcDevRead(
     regDevTransferComplete callback __attribute__((unused)),
     const char* user)
 {
-    size_t i;
-    epicsUInt32 value;
+    toscaSbcOp ops[SBC_BATCH];
+    size_t i, n, done;
 
     debugLvl(2, "%s %s(FMC%d):0x%zx dlen=%d nelm=%zd", user, regDevName(device), device->fmc, offset, dlen, nelem);
     if (dlen == 0) return 0; /* any way to check online status ? */
+    if (dlen != 1 && dlen != 2 && dlen != 4) return -1;
     offset += device->base;
-    for (i = 0; i < nelem; i++)
+    for (done = 0; done < nelem; done += n)
     {
-        value = toscaSbcRead(device->fmc, offset+i);
-        if (errno)
+        n = nelem - done < SBC_BATCH ? nelem - done : SBC_BATCH;
+        for (i = 0; i < n; i++)
+        {
+            ops[i].reg = offset + done + i;
+            ops[i].mask = 0;
+            ops[i].value = 0;
+            ops[i].verify = 0;
+        }
+        if (toscaSbcBatch(device->fmc, ops, n) != n)
         {
-            debugErrno("toscaSbcRead(%d,0x%zx)", device->fmc, offset+i);
+            debugErrno("toscaSbcBatch(%d,0x%zx,%zu)", device->fmc, offset+done, n);
             return errno;
         }
-        switch (dlen)
+        for (i = 0; i < n; i++)
         {
-            case 1: ((epicsUInt8*)pdata)[i] = (epicsUInt8)value; break;
-            case 2: ((epicsUInt16*)pdata)[i] = (epicsUInt16)value; break;
-            case 4: ((epicsUInt32*)pdata)[i] = (epicsUInt32)value; break;
-            default: return -1;
+            switch (dlen)
+            {
+                case 1: ((epicsUInt8*)pdata)[done+i] = (epicsUInt8)ops[i].value; break;
+                case 2: ((epicsUInt16*)pdata)[done+i] = (epicsUInt16)ops[i].value; break;
+                case 4: ((epicsUInt32*)pdata)[done+i] = (epicsUInt32)ops[i].value; break;
+            }
         }
     }
     return 0;
@@ -69,8 +82,8 @@ int toscaSbcDevWrite(
     regDevTransferComplete callback __attribute__((unused)),
     const char* user)
 {
-    size_t i;
-    epicsUInt32 value;
+    toscaSbcOp ops[SBC_BATCH];
+    size_t i, n, done;
     epicsUInt32 mask = 0xffffffff;
 
     if (pmask)
@@ -84,20 +97,26 @@ int toscaSbcDevWrite(
         }
     }
     debugLvl(2, "%s %s(FMC%d):0x%zx dlen=%d nelm=%zd mask=0x%x", user, regDevName(device), device->fmc, offset, dlen, nelem, mask);
+    if (dlen != 1 && dlen != 2 && dlen != 4) return -1;
     offset += device->base;
-    for (i = 0; i < nelem; i++)
+    for (done = 0; done < nelem; done += n)
     {
-        switch (dlen)
+        n = nelem - done < SBC_BATCH ? nelem - done : SBC_BATCH;
+        for (i = 0; i < n; i++)
         {
-            case 1: value = ((epicsUInt8*)pdata)[i]; break;
-            case 2: value = ((epicsUInt16*)pdata)[i]; break;
-            case 4: value = ((epicsUInt32*)pdata)[i]; break;
-            default: return -1;
+            ops[i].reg = offset + done + i;
+            ops[i].mask = mask;
+            switch (dlen)
+            {
+                case 1: ops[i].value = ((epicsUInt8*)pdata)[done+i]; break;
+                case 2: ops[i].value = ((epicsUInt16*)pdata)[done+i]; break;
+                case 4: ops[i].value = ((epicsUInt32*)pdata)[done+i]; break;
+            }
+            ops[i].verify = 0;
         }
-        toscaSbcWriteMasked(device->fmc, offset+i, mask, value);
-        if (errno)
+        if (toscaSbcBatch(device->fmc, ops, n) != n)
         {
-            debugErrno("toscaSbcWriteMasked(%d, 0x%zx, 0x%x, 0x%x)", device->fmc, offset+i, mask, value);
+            debugErrno("toscaSbcBatch(%d,0x%zx,%zu) mask=0x%x", device->fmc, offset+done, n, mask);
             return errno;
         }
     }
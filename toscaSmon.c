@@ -5,6 +5,7 @@
 #include <epicsTypes.h>
 #include <iocsh.h>
 #include <epicsStdioRedirect.h>
+#include <dbScan.h>
 #include <regDev.h>
 #include "toscaReg.h"
 #include "toscaMap.h"
@@ -264,12 +265,34 @@ static void toscaSmonClearFunc(const iocshArgBuf *args)
 
 struct regDevice
 {
-    void* nope;
+    double period;
+    IOSCANPVT ioscanpvt;
 };
 
-void smonDevReport(regDevice *device __attribute__((unused)), int level __attribute__((unused)))
+void smonDevReport(regDevice *device, int level __attribute__((unused)))
 {
-    printf("Tosca Virtex FPGA System Monitor\n");
+    printf("Tosca Virtex FPGA System Monitor");
+    if (device->period > 0)
+        printf(", sampled every %g s, %llu updates", device->period, toscaSmonSamplerUpdates(0));
+    printf("\n");
+}
+
+static void smonDevUpdated(void* usr)
+{
+    scanIoRequest(((regDevice*)usr)->ioscanpvt);
+}
+
+static IOSCANPVT smonDevGetIoScanPvt(
+    regDevice *device,
+    size_t offset __attribute__((unused)),
+    unsigned int dlen __attribute__((unused)),
+    size_t nelm __attribute__((unused)),
+    int ivec __attribute__((unused)),
+    const char* user)
+{
+    if (!device->ioscanpvt)
+        error("%s %s: I/O Intr needs a sampling period", regDevName(device), user);
+    return device->ioscanpvt;
 }
 
 int smonDevRead(
@@ -286,9 +309,21 @@ int smonDevRead(
 
     if (dlen != 2)
     {
-        error("%s %s: dlen must be 4 bytes", regDevName(device), user);
+        error("%s %s: dlen must be 2 bytes", regDevName(device), user);
         return -1;
     }
+    if (device->period > 0)
+    {
+        unsigned int values[nelem];
+        if (toscaSmonSnapshot(offset, nelem, values) != 0)
+        {
+            debugErrno("%s %s: toscaSmonSnapshot(0x%zx, %zu)", regDevName(device), user, offset, nelem);
+            return -1;
+        }
+        for (i = 0; i < nelem; i++)
+            ((epicsUInt16*) pdata)[i] = values[i];
+        return 0;
+    }
     for (i = 0; i < nelem; i++)
         ((epicsUInt16*) pdata)[i] = toscaSmonRead(offset+i);
     return 0;
@@ -330,18 +365,19 @@ struct regDevSupport smonDev = {
     .report = smonDevReport,
     .read = smonDevRead,
     .write = smonDevWrite,
+    .getInScanPvt = smonDevGetIoScanPvt,
 };
 
-int toscaSmonDevConfigure(const char* name)
+int toscaSmonDevConfigure(const char* name, double period)
 {
     regDevice *device = NULL;
 
     if (!name || !name[0])
     {
-        printf("usage: toscaSmonDevConfigure name\n");
+        printf("usage: toscaSmonDevConfigure name [sample_period_sec]\n");
         return -1;
     }
-    device = malloc(sizeof(regDevice));
+    device = calloc(1, sizeof(regDevice));
     if (!device)
     {
         fprintf(stderr, "malloc regDevice failed: %m\n");
@@ -352,6 +388,18 @@ int toscaSmonDevConfigure(const char* name)
         fprintf(stderr, "regDevRegisterDevice() failed: %m\n");
         goto fail;
     }
+    if (period > 0)
+    {
+        /* reads come from memory: no work queue needed */
+        device->period = period;
+        scanIoInit(&device->ioscanpvt);
+        if (toscaSmonSamplerStart(0, period, smonDevUpdated, device) != 0)
+        {
+            fprintf(stderr, "toscaSmonSamplerStart() failed: %m\n");
+            return -1;
+        }
+        return 0;
+    }
     if (regDevInstallWorkQueue(device, 100) != SUCCESS)
     {
         fprintf(stderr, "regDevInstallWorkQueue() failed: %m\n");
@@ -365,13 +413,26 @@ fail:
 }
 
 static const iocshFuncDef toscaSmonDevConfigureDef =
-    { "toscaSmonDevConfigure", 1, (const iocshArg *[]) {
+    { "toscaSmonDevConfigure", 2, (const iocshArg *[]) {
     &(iocshArg) { "name", iocshArgString },
+    &(iocshArg) { "sample_period_sec", iocshArgDouble },
 }};
 
 static void toscaSmonDevConfigureFunc(const iocshArgBuf *args)
 {
-    toscaSmonDevConfigure(args[0].sval);
+    toscaSmonDevConfigure(args[0].sval, args[1].dval);
+}
+
+static const iocshFuncDef toscaSmonSamplerStartDef =
+    { "toscaSmonSamplerStart", 2, (const iocshArg *[]) {
+    &(iocshArg) { "period_sec", iocshArgDouble },
+    &(iocshArg) { "device", iocshArgInt },
+}};
+
+static void toscaSmonSamplerStartFunc(const iocshArgBuf *args)
+{
+    if (toscaSmonSamplerStart(args[1].ival, args[0].dval, NULL, NULL) != 0)
+        fprintf(stderr, "%m\n");
 }
 
 static void toscaSmonRegistrar(void)
@@ -382,6 +443,7 @@ static void toscaSmonRegistrar(void)
     iocshRegister(&toscaSmonWriteMaskedDef, toscaSmonWriteMaskedFunc);
     iocshRegister(&toscaSmonSetDef, toscaSmonSetFunc);
     iocshRegister(&toscaSmonClearDef, toscaSmonClearFunc);
+    iocshRegister(&toscaSmonSamplerStartDef, toscaSmonSamplerStartFunc);
 }
 
 epicsExportRegistrar(toscaSmonRegistrar);
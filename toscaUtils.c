@@ -11,6 +11,7 @@
 
 #include "toscaMap.h"
 #include "toscaDma.h"
+#include "toscaCopy.h"
 
 #include <iocsh.h>
 #include <epicsStdioRedirect.h>
@@ -39,6 +40,26 @@ static void mallocFunc(const iocshArgBuf *args)
     printf("BUFFER = %s\n", b);
 }
 
+static const iocshFuncDef dmaallocDef =
+    { "dmaalloc", 1, (const iocshArg *[]) {
+    &(iocshArg) { "size", iocshArgString },
+}};
+
+static void dmaallocFunc(const iocshArgBuf *args)
+{
+    void *p;
+    char b[20];
+    if (!args[0].sval)
+    {
+        iocshCmd("help dmaalloc");
+        return;
+    }
+    p = toscaDmaAlloc(toscaStrToSize(args[0].sval));
+    sprintf(b, "%p", p);
+    setenv("BUFFER", b, 1);
+    printf("BUFFER = %s\n", b);
+}
+
 static const iocshFuncDef memfillDef =
     { "memfill", 5, (const iocshArg *[]) {
     &(iocshArg) { "address", iocshArgString },
@@ -164,6 +185,7 @@ void memcopyFunc(const iocshArgBuf *args)
     volatile void* sourceptr;
     volatile void* destptr;
     toscaMapAddr_t addr;
+    unsigned int srcspace, destspace;
     size_t size, i;
     int width;
 
@@ -175,6 +197,7 @@ void memcopyFunc(const iocshArgBuf *args)
     size = toscaStrToSize(args[2].sval);
 
     addr = toscaStrToAddr(args[0].sval, NULL);
+    srcspace = addr.addrspace;
     if (addr.addrspace)
         sourceptr = toscaMap(addr.addrspace, addr.address, size, 0);
     else
@@ -186,6 +209,7 @@ void memcopyFunc(const iocshArgBuf *args)
     }
 
     addr = toscaStrToAddr(args[1].sval, NULL);
+    destspace = addr.addrspace;
     if (addr.addrspace)
         destptr = toscaMap(addr.addrspace, addr.address, size, 0);
     else
@@ -203,7 +227,11 @@ void memcopyFunc(const iocshArgBuf *args)
     switch (width)
     {
         case 0:
-            memcpy((void*)destptr, (void*)sourceptr, size);
+            if (srcspace && !destspace)
+                /* reading from a map is slow: use wide reads suitable for the address space */
+                toscaCopyRead((void*)destptr, sourceptr, size, toscaCopyReadWidth(srcspace));
+            else
+                memcpy((void*)destptr, (void*)sourceptr, size);
             break;
         case 1:
         case -1:
@@ -231,23 +259,16 @@ void memcopyFunc(const iocshArgBuf *args)
             }
             break;
         case -2:
-            for (i = 0; i < size/2; i++)
-            {
-                ((uint16_t*)destptr)[i] = bswap_16(((uint16_t*)sourceptr)[i]);
-            }
-            break;
         case -4:
-            for (i = 0; i < size/4; i++)
-            {
-                ((uint32_t*)destptr)[i] = bswap_32(((uint32_t*)sourceptr)[i]);
-            }
-            break;
         case -8:
-            for (i = 0; i < size/8; i++)
-            {
-                ((uint64_t*)destptr)[i] = bswap_64(((uint64_t*)sourceptr)[i]);
-            }
+        {
+            /* wide accesses only where both sides are memory */
+            unsigned int maxwidth = toscaCopySwapMaxWidth(srcspace);
+            unsigned int w = toscaCopySwapMaxWidth(destspace);
+            if (!maxwidth || (w && w < maxwidth)) maxwidth = w;
+            toscaCopySwapWidth(destptr, sourceptr, size/-width, -width, maxwidth);
             break;
+        }
         default:
             fprintf(stderr, "Illegal width %d: must be 1, 2, 4, 8, -2, -4, -8\n", width);
             return;
@@ -391,6 +412,7 @@ static void memcompFunc(const iocshArgBuf *args)
 static void toscaUtilsRegistrar(void)
 {
     iocshRegister(&mallocDef, mallocFunc);
+    iocshRegister(&dmaallocDef, dmaallocFunc);
     iocshRegister(&memfillDef, memfillFunc);
     iocshRegister(&memcopyDef, memcopyFunc);
     iocshRegister(&memcompDef, memcompFunc);